@@ -0,0 +1,73 @@
+// Runs one simulator command and reports its wall time, peak memory and event rate as a
+// CSV line, so runs before and after an engine change can be compared line by line.
+// The event count is read from the "Events processed:" line the simulator prints at the end.
+//
+// Build: g++ -std=c++17 -O2 -o benchrunner BenchRunner.cpp
+// Run:   ./benchrunner <label> <simulator> [simulator arguments...]
+// Output: label,seconds,peak_rss_kb,events,events_per_second
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <label> <simulator> [simulator arguments...]" << endl;
+        return 1;
+    }
+
+    int pipeEnds[2];
+    if (pipe(pipeEnds) != 0) {
+        cerr << "Failed to create a pipe" << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    pid_t child = fork();
+    if (child < 0) {
+        cerr << "Failed to start " << argv[2] << endl;
+        return 1;
+    }
+    if (child == 0) {
+        dup2(pipeEnds[1], STDOUT_FILENO);
+        close(pipeEnds[0]);
+        close(pipeEnds[1]);
+        execvp(argv[2], argv + 2);
+        cerr << "Failed to run " << argv[2] << endl;
+        _exit(127);
+    }
+    close(pipeEnds[1]);
+
+    // Keeps the simulator's output to find the event count in it
+    string output;
+    vector<char> chunk(1 << 16);
+    ssize_t got;
+    while ((got = read(pipeEnds[0], chunk.data(), chunk.size())) > 0) {
+        output.append(chunk.data(), got);
+    }
+    close(pipeEnds[0]);
+
+    int status = 0;
+    struct rusage usage {};
+    wait4(child, &status, 0, &usage);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        cerr << argv[1] << ": simulator failed" << endl;
+        return 1;
+    }
+
+    unsigned long long events = 0;
+    const string marker = "Events processed: ";
+    size_t at = output.rfind(marker);
+    if (at != string::npos) events = stoull(output.substr(at + marker.size()));
+
+    cout << argv[1] << ',' << seconds << ',' << usage.ru_maxrss << ',' << events << ','
+        << (seconds > 0 ? static_cast<unsigned long long>(events / seconds) : 0) << endl;
+    return 0;
+}
@@ -0,0 +1,243 @@
+// Generates large circuits in the Tests/ .cir format, built from the cells of a library
+// file, together with a matching .stim file of random input vectors.
+//
+// Build: g++ -std=c++17 -O2 -o circuitgen CircuitGenerator.cpp
+// Run:   ./circuitgen <library file> <kind> <size> <output prefix> [vectors] [period] [seed]
+//
+// Kinds:
+//   adder       ripple-carry adder of <size> bits (XOR2 and MAJ3 per bit)
+//   multiplier  <size> x <size> bit array multiplier (AND2 partial products, full adder rows)
+//   random      random DAG of <size> gates over every library cell with up to 4 inputs;
+//               each gate reads signals from the last few thousand, so activity stays local
+//
+// Writes <prefix>.cir and <prefix>.stim. The stimuli apply <vectors> random input vectors,
+// one every <period> time units, each changing about half of the primary inputs.
+
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Cell {
+    string name;
+    int inputs;
+};
+
+// Writes gates and names the signals they create
+class CircuitWriter {
+public:
+    explicit CircuitWriter(const string& path) {
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size()); // Must come before open
+        file.open(path);
+    }
+
+    bool isOpen() const { return file.is_open(); }
+
+    string newSignal() { return "w" + to_string(wires++); }
+
+    void gate(const string& cell, const string& output, const vector<string>& inputs) {
+        file << 'G' << gates++ << ' ' << cell << ' ' << output;
+        for (const string& input : inputs) file << ' ' << input;
+        file << '\n';
+    }
+
+    size_t numGates() const { return gates; }
+
+private:
+    vector<char> buffer = vector<char>(1 << 20);
+    ofstream file;
+    size_t gates = 0;
+    size_t wires = 0;
+};
+
+static bool loadCells(const string& path, vector<Cell>& cells) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        cerr << "Failed to open library file: " << path << endl;
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        istringstream ss(line);
+        string name, inputs;
+        if (getline(ss, name, ',') && getline(ss, inputs, ',') && !name.empty()) {
+            cells.push_back({ name, stoi(inputs) });
+        }
+    }
+    return true;
+}
+
+static bool hasCells(const vector<Cell>& cells, const vector<string>& names) {
+    for (const string& name : names) {
+        bool found = false;
+        for (const Cell& cell : cells) found = found || cell.name == name;
+        if (!found) {
+            cerr << "The library has no " << name << " cell" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// sum = a ^ b ^ carry, carryOut = majority(a, b, carry)
+static void fullAdder(CircuitWriter& out, const string& a, const string& b, const string& carry,
+    const string& sum, const string& carryOut) {
+    string half = out.newSignal();
+    out.gate("XOR2", half, { a, b });
+    out.gate("XOR2", sum, { half, carry });
+    out.gate("MAJ3", carryOut, { a, b, carry });
+}
+
+static vector<string> makeAdder(CircuitWriter& out, int bits) {
+    vector<string> inputs;
+    for (int i = 0; i < bits; ++i) inputs.push_back("a" + to_string(i));
+    for (int i = 0; i < bits; ++i) inputs.push_back("b" + to_string(i));
+    inputs.push_back("cin");
+
+    string carry = "cin";
+    for (int i = 0; i < bits; ++i) {
+        string carryOut = i + 1 == bits ? "cout" : out.newSignal();
+        fullAdder(out, "a" + to_string(i), "b" + to_string(i), carry, "s" + to_string(i), carryOut);
+        carry = carryOut;
+    }
+    return inputs;
+}
+
+// Adds the rows of partial products a[j] & b[i] one at a time with ripple-carry adders
+static vector<string> makeMultiplier(CircuitWriter& out, int bits) {
+    vector<string> inputs;
+    for (int i = 0; i < bits; ++i) inputs.push_back("a" + to_string(i));
+    for (int i = 0; i < bits; ++i) inputs.push_back("b" + to_string(i));
+
+    auto partial = [&](int i, int j) {
+        string product = out.newSignal();
+        out.gate("AND2", product, { "a" + to_string(j), "b" + to_string(i) });
+        return product;
+    };
+
+    // Before row i, 'row' holds the running sum's bits from weight i - 1 upward; its
+    // lowest bit is final, so each row only adds into the ones above it
+    vector<string> row;
+    for (int j = 0; j < bits; ++j) row.push_back(partial(0, j));
+
+    for (int i = 1; i < bits; ++i) {
+        vector<string> next;
+        string carry;
+        for (int j = 0; j < bits; ++j) {
+            string product = partial(i, j);
+            string upper = j + 1 < static_cast<int>(row.size()) ? row[j + 1] : "";
+            if (upper.empty() && carry.empty()) {
+                next.push_back(product);
+                continue;
+            }
+            string sum = out.newSignal();
+            string carryOut = out.newSignal();
+            if (upper.empty() || carry.empty()) { // Half adder
+                const string& other = upper.empty() ? carry : upper;
+                out.gate("XOR2", sum, { product, other });
+                out.gate("AND2", carryOut, { product, other });
+            }
+            else {
+                fullAdder(out, product, upper, carry, sum, carryOut);
+            }
+            next.push_back(sum);
+            carry = carryOut;
+        }
+        if (!carry.empty()) next.push_back(carry);
+        row = next;
+    }
+    return inputs;
+}
+
+static vector<string> makeRandom(CircuitWriter& out, const vector<Cell>& cells, size_t numGates, mt19937_64& rng) {
+    vector<Cell> usable;
+    for (const Cell& cell : cells) {
+        if (cell.inputs >= 1 && cell.inputs <= 4) usable.push_back(cell);
+    }
+
+    size_t numInputs = 64;
+    while (numInputs * numInputs < numGates && numInputs < 4096) numInputs *= 2;
+    vector<string> inputs;
+    for (size_t i = 0; i < numInputs; ++i) inputs.push_back("in" + to_string(i));
+
+    // Gate g reads from the window of signals created just before it
+    const size_t window = 4096;
+    vector<string> recent(inputs);
+    vector<string> gateInputs;
+    for (size_t g = 0; g < numGates; ++g) {
+        const Cell& cell = usable[rng() % usable.size()];
+        gateInputs.clear();
+        size_t first = recent.size() > window ? recent.size() - window : 0;
+        for (int k = 0; k < cell.inputs; ++k) {
+            gateInputs.push_back(recent[first + rng() % (recent.size() - first)]);
+        }
+        string output = out.newSignal();
+        out.gate(cell.name, output, gateInputs);
+        if (recent.size() >= 2 * window) recent.erase(recent.begin(), recent.begin() + window);
+        recent.push_back(output);
+    }
+    return inputs;
+}
+
+static bool writeStimuli(const string& path, const vector<string>& inputs, int vectors, int period, mt19937_64& rng) {
+    ofstream file(path);
+    if (!file.is_open()) {
+        cerr << "Failed to open stimuli file for writing: " << path << endl;
+        return false;
+    }
+    vector<int> values(inputs.size(), 0);
+    for (int v = 0; v < vectors; ++v) {
+        int time = (v + 1) * period;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (rng() & 1) continue;
+            values[i] ^= 1;
+            file << time << ' ' << inputs[i] << ' ' << values[i] << '\n';
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        cerr << "Usage: " << argv[0] << " <library file> <adder|multiplier|random> <size> <output prefix> [vectors] [period] [seed]" << endl;
+        return 1;
+    }
+    string kind = argv[2];
+    size_t size = stoull(argv[3]);
+    string prefix = argv[4];
+    int vectors = argc > 5 ? stoi(argv[5]) : 100;
+    int period = argc > 6 ? stoi(argv[6]) : 10000;
+    mt19937_64 rng(argc > 7 ? stoull(argv[7]) : 1);
+
+    vector<Cell> cells;
+    if (!loadCells(argv[1], cells)) return 1;
+
+    CircuitWriter out(prefix + ".cir");
+    if (!out.isOpen()) {
+        cerr << "Failed to open circuit file for writing: " << prefix << ".cir" << endl;
+        return 1;
+    }
+
+    vector<string> inputs;
+    if (kind == "adder" && hasCells(cells, { "XOR2", "MAJ3" })) {
+        inputs = makeAdder(out, static_cast<int>(size));
+    }
+    else if (kind == "multiplier" && hasCells(cells, { "XOR2", "MAJ3", "AND2" })) {
+        inputs = makeMultiplier(out, static_cast<int>(size));
+    }
+    else if (kind == "random") {
+        inputs = makeRandom(out, cells, size, rng);
+    }
+    else {
+        cerr << "Unknown circuit kind or missing cells: " << kind << endl;
+        return 1;
+    }
+
+    if (!writeStimuli(prefix + ".stim", inputs, vectors, period, rng)) return 1;
+    cout << "Wrote " << out.numGates() << " gates and " << inputs.size() << " inputs to " << prefix << ".cir" << endl;
+    return 0;
+}
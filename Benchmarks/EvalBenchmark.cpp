@@ -0,0 +1,196 @@
+// Microbenchmark comparing the original per-call infix evaluator with the
+// expressions compiled once by parseLib. Every library gate is checked on all
+// input combinations (65536 of them above 16 inputs) before it is timed.
+//
+// Build: g++ -std=c++17 -O2 -o evalbench EvalBenchmark.cpp ../Codes/CompiledExpr.cpp
+// Run:   ./evalbench ../Tests/library.lib [iterations]
+
+#include "../Codes/CompiledExpr.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stack>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// The evaluator as it was before compilation: converts to postfix on every call
+// and looks every operand up by name.
+static vector<string> legacyInfixToPostfix(const string& expression) {
+    stack<string> opStack;
+    vector<string> output;
+    unordered_map<string, int> precedence{ {"~", 3}, {"&", 2}, {"|", 1}, {"^", 1} };
+
+    for (size_t i = 0; i < expression.size(); ++i) {
+        if (isalnum(expression[i])) {
+            string val;
+            while (i < expression.size() && isalnum(expression[i])) {
+                val += expression[i++];
+            }
+            --i;
+            output.push_back(val);
+        }
+        else if (expression[i] == '(') {
+            opStack.push("(");
+        }
+        else if (expression[i] == ')') {
+            while (!opStack.empty() && opStack.top() != "(") {
+                output.push_back(opStack.top());
+                opStack.pop();
+            }
+            if (!opStack.empty()) opStack.pop();
+        }
+        else {
+            string op(1, expression[i]);
+            while (!opStack.empty() && precedence[opStack.top()] >= precedence[op]) {
+                output.push_back(opStack.top());
+                opStack.pop();
+            }
+            opStack.push(op);
+        }
+    }
+    while (!opStack.empty()) {
+        output.push_back(opStack.top());
+        opStack.pop();
+    }
+    return output;
+}
+
+static int legacyEvaluate(const string& expression, const unordered_map<string, int>& signalStates) {
+    auto postfixExpr = legacyInfixToPostfix(expression);
+    stack<int> evalStack;
+    for (const auto& token : postfixExpr) {
+        if (token == "~" || token == "&" || token == "|" || token == "^") {
+            int result = 0;
+            if (token == "~") {
+                int op1 = evalStack.top(); evalStack.pop();
+                result = ~op1 & 1;
+            }
+            else {
+                int op2 = evalStack.top(); evalStack.pop();
+                int op1 = evalStack.top(); evalStack.pop();
+                if (token == "&") result = op1 & op2;
+                else if (token == "|") result = op1 | op2;
+                else result = op1 ^ op2;
+            }
+            evalStack.push(result);
+        }
+        else {
+            evalStack.push(signalStates.at(token));
+        }
+    }
+    return !evalStack.empty() ? evalStack.top() : 0;
+}
+
+// The low 'numInputs' bits, for up to 32 inputs
+static uint32_t inputMask(int numInputs) {
+    return static_cast<uint32_t>((uint64_t(1) << numInputs) - 1);
+}
+
+struct LibraryEntry {
+    string name;
+    string expression;
+    CompiledExpr compiled;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <library file> [iterations]" << endl;
+        return 1;
+    }
+    long iterations = argc > 2 ? atol(argv[2]) : 200000;
+    if (iterations < 1) {
+        cerr << "The number of iterations must be positive" << endl;
+        return 1;
+    }
+
+    ifstream file(argv[1]);
+    if (!file.is_open()) {
+        cerr << "Failed to open library file: " << argv[1] << endl;
+        return 1;
+    }
+
+    vector<LibraryEntry> entries;
+    string line;
+    while (getline(file, line)) {
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        istringstream ss(line);
+        LibraryEntry entry;
+        int numOfInputs = 0;
+        getline(ss, entry.name, ',');
+        ss >> numOfInputs >> ws;
+        ss.ignore();
+        getline(ss, entry.expression, ',');
+
+        string error;
+        if (!compileExpression(entry.expression, numOfInputs, entry.compiled, error)) {
+            cerr << "Skipping " << entry.name << ": " << error << endl;
+            continue;
+        }
+        entries.push_back(entry);
+    }
+    if (entries.empty()) {
+        cerr << "No gate of " << argv[1] << " could be compiled; nothing to time" << endl;
+        return 1;
+    }
+
+    // Checks both evaluators agree on every input combination
+    for (const auto& entry : entries) {
+        int n = entry.compiled.numInputs;
+        unordered_map<string, int> states;
+        // Gates of more than 16 inputs get 65536 combinations spread over all of theirs, as n may be up to 32
+        uint64_t checked = uint64_t(1) << min(n, 16);
+        for (uint64_t combination = 0; combination < checked; ++combination) {
+            uint32_t packed = n <= 16 ? static_cast<uint32_t>(combination) : static_cast<uint32_t>((combination * 0x9E3779B97F4A7C15ull) >> (64 - n));
+            for (int k = 0; k < n; ++k) states["i" + to_string(k + 1)] = (packed >> k) & 1;
+            if (legacyEvaluate(entry.expression, states) != entry.compiled.evaluate(packed)
+                || entry.compiled.runBytecode(packed) != entry.compiled.evaluate(packed)) {
+                cerr << "Mismatch for " << entry.name << " on inputs " << packed << endl;
+                return 1;
+            }
+        }
+    }
+
+    using Clock = chrono::steady_clock;
+    long checksum = 0;
+
+    auto start = Clock::now();
+    unordered_map<string, int> states;
+    for (long it = 0; it < iterations; ++it) {
+        const auto& entry = entries[it % entries.size()];
+        for (int k = 0; k < entry.compiled.numInputs; ++k) states["i" + to_string(k + 1)] = (it >> k) & 1;
+        checksum += legacyEvaluate(entry.expression, states);
+    }
+    double legacySeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (long it = 0; it < iterations; ++it) {
+        const auto& entry = entries[it % entries.size()];
+        checksum -= entry.compiled.runBytecode(static_cast<uint32_t>(it) & inputMask(entry.compiled.numInputs));
+    }
+    double bytecodeSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    for (long it = 0; it < iterations; ++it) {
+        const auto& entry = entries[it % entries.size()];
+        checksum += entry.compiled.evaluate(static_cast<uint32_t>(it) & inputMask(entry.compiled.numInputs));
+    }
+    double tableSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    auto report = [&](const char* label, double seconds) {
+        cout << label << ": " << seconds * 1e9 / iterations << " ns/eval ("
+            << iterations / seconds / 1e6 << " M evals/s)" << endl;
+    };
+    cout << entries.size() << " gates, " << iterations << " evaluations each method" << endl;
+    report("Legacy infix evaluator ", legacySeconds);
+    report("Compiled bytecode      ", bytecodeSeconds);
+    report("Compiled truth table   ", tableSeconds);
+    cout << "Checksum: " << checksum << endl; // Keeps the loops from being optimized away
+    return 0;
+}
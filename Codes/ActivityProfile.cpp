@@ -0,0 +1,188 @@
+#include "ActivityProfile.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+using namespace std;
+
+void ActivityProfile::reset(int numGates, int numSignals) {
+    gateEvaluations.assign(numGates, 0);
+    gateScheduled.assign(numGates, 0);
+    gateCancelled.assign(numGates, 0);
+    signalEvents.assign(numSignals, 0);
+    signalChanges.assign(numSignals, 0);
+    queueSamples.clear();
+    sampleInterval = 1;
+    nextSample = 0;
+}
+
+void ActivityProfile::addSample(int time, size_t pending) {
+    queueSamples.push_back({ time, pending, pending });
+    if (queueSamples.size() > MAX_SAMPLES) {
+        // Keeps every other sample; each kept one's peak now covers the one dropped after it
+        size_t kept = 0;
+        for (size_t k = 0; k < queueSamples.size(); k += 2) {
+            QueueSample sample = queueSamples[k];
+            if (k + 1 < queueSamples.size()) sample.peak = max(sample.peak, queueSamples[k + 1].peak);
+            queueSamples[kept++] = sample;
+        }
+        queueSamples.resize(kept);
+        sampleInterval *= 2;
+    }
+    nextSample = static_cast<long long>(queueSamples.back().time) + sampleInterval;
+}
+
+// Indices of the 'top' nonzero entries of 'counts', largest first, ties in id order
+static vector<int> busiest(const vector<uint64_t>& counts, size_t top) {
+    vector<int> ids;
+    for (size_t id = 0; id < counts.size(); ++id) {
+        if (counts[id] > 0) ids.push_back(static_cast<int>(id));
+    }
+    auto more = [&](int a, int b) { return counts[a] != counts[b] ? counts[a] > counts[b] : a < b; };
+    if (ids.size() > top) {
+        partial_sort(ids.begin(), ids.begin() + top, ids.end(), more);
+        ids.resize(top);
+    }
+    else {
+        sort(ids.begin(), ids.end(), more);
+    }
+    return ids;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(whole);
+}
+
+void ActivityProfile::printReport(ostream& out, const Netlist& netlist, const vector<string>& extraSignals, size_t top) const {
+    auto signalName = [&](int signal) -> string {
+        return signal < netlist.numSignals() ? netlist.signalName(signal) : extraSignals[signal - netlist.numSignals()];
+    };
+    uint64_t evaluations = accumulate(gateEvaluations.begin(), gateEvaluations.end(), uint64_t(0));
+    uint64_t events = accumulate(signalEvents.begin(), signalEvents.end(), uint64_t(0));
+    ios_base::fmtflags flags = out.flags();
+    out << fixed << setprecision(2);
+
+    out << "Busiest gates (of " << evaluations << " evaluations):\n"
+        << "  " << left << setw(20) << "gate" << setw(16) << "type" << right << setw(12) << "evaluations" << setw(9) << "share"
+        << setw(12) << "scheduled" << setw(12) << "cancelled" << '\n';
+    for (int gate : busiest(gateEvaluations, top)) {
+        out << "  " << left << setw(20) << netlist.gateName(gate) << setw(16) << netlist.typeNames[netlist.gate(gate).type()]
+            << right << setw(12) << gateEvaluations[gate] << setw(8) << percent(gateEvaluations[gate], evaluations) << '%'
+            << setw(12) << gateScheduled[gate] << setw(12) << gateCancelled[gate] << '\n';
+    }
+
+    out << "Busiest signals (of " << events << " events):\n"
+        << "  " << left << setw(20) << "signal" << right << setw(12) << "events" << setw(9) << "share" << setw(12) << "changes" << '\n';
+    for (int signal : busiest(signalEvents, top)) {
+        out << "  " << left << setw(20) << signalName(signal) << right << setw(12) << signalEvents[signal]
+            << setw(8) << percent(signalEvents[signal], events) << '%' << setw(12) << signalChanges[signal] << '\n';
+    }
+
+    // Totals per library gate, busiest first
+    size_t numTypes = netlist.typeNames.size();
+    vector<uint64_t> typeGates(numTypes, 0), typeEvaluations(numTypes, 0), typeScheduled(numTypes, 0);
+    for (int gate = 0; gate < netlist.numGates(); ++gate) {
+        int type = netlist.gate(gate).type();
+        ++typeGates[type];
+        typeEvaluations[type] += gateEvaluations[gate];
+        typeScheduled[type] += gateScheduled[gate];
+    }
+    out << "Activity per gate type:\n"
+        << "  " << left << setw(20) << "type" << right << setw(8) << "gates" << setw(12) << "evaluations" << setw(9) << "share"
+        << setw(12) << "scheduled" << '\n';
+    for (int type : busiest(typeEvaluations, numTypes)) {
+        out << "  " << left << setw(20) << netlist.typeNames[type] << right << setw(8) << typeGates[type]
+            << setw(12) << typeEvaluations[type] << setw(8) << percent(typeEvaluations[type], evaluations) << '%'
+            << setw(12) << typeScheduled[type] << '\n';
+    }
+
+    if (!queueSamples.empty()) {
+        size_t peak = 0;
+        double mean = 0;
+        for (size_t k = 0; k < queueSamples.size(); ++k) {
+            if (queueSamples[k].peak > queueSamples[peak].peak) peak = k;
+            mean += static_cast<double>(queueSamples[k].pending);
+        }
+        mean /= static_cast<double>(queueSamples.size());
+        // A sample covers the timestamps up to the next one
+        out << "Queue depth: at most " << queueSamples[peak].peak << " events pending, ";
+        if (sampleInterval == 1) {
+            out << "at time " << queueSamples[peak].time;
+        }
+        else if (peak + 1 < queueSamples.size()) {
+            out << "between time " << queueSamples[peak].time << " and " << queueSamples[peak + 1].time;
+        }
+        else {
+            out << "from time " << queueSamples[peak].time << " on";
+        }
+        out << "; " << mean << " on average over " << queueSamples.size() << " samples" << '\n';
+    }
+    out.flags(flags);
+    out << flush;
+}
+
+// Quotes a name for JSON or CSV. Names come from the input files and never hold line breaks.
+static string quoted(const string& name, char escape) {
+    string text = "\"";
+    for (char c : name) {
+        if (c == '"' || c == '\\') {
+            if (c == '"' || escape == '\\') text += escape;
+        }
+        text += c;
+    }
+    return text + '"';
+}
+
+bool ActivityProfile::write(const string& path, const Netlist& netlist, const vector<string>& extraSignals) const {
+    ofstream out(path);
+    if (!out) {
+        cerr << "Failed to open the profile file for writing: " << path << endl;
+        return false;
+    }
+    auto signalName = [&](int signal) -> string {
+        return signal < netlist.numSignals() ? netlist.signalName(signal) : extraSignals[signal - netlist.numSignals()];
+    };
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+
+    if (json) {
+        out << "{\n  \"gates\": [";
+        for (int gate = 0; gate < netlist.numGates(); ++gate) {
+            out << (gate ? ",\n    " : "\n    ") << "{\"id\": " << gate << ", \"name\": " << quoted(netlist.gateName(gate), '\\')
+                << ", \"type\": " << quoted(netlist.typeNames[netlist.gate(gate).type()], '\\') << ", \"evaluations\": " << gateEvaluations[gate]
+                << ", \"scheduled\": " << gateScheduled[gate] << ", \"cancelled\": " << gateCancelled[gate] << '}';
+        }
+        out << "\n  ],\n  \"signals\": [";
+        for (size_t signal = 0; signal < signalEvents.size(); ++signal) {
+            out << (signal ? ",\n    " : "\n    ") << "{\"id\": " << signal << ", \"name\": " << quoted(signalName(static_cast<int>(signal)), '\\')
+                << ", \"events\": " << signalEvents[signal] << ", \"changes\": " << signalChanges[signal] << '}';
+        }
+        out << "\n  ],\n  \"queue\": {\"interval\": " << sampleInterval << ", \"samples\": [";
+        for (size_t k = 0; k < queueSamples.size(); ++k) {
+            out << (k ? ",\n    " : "\n    ") << "{\"time\": " << queueSamples[k].time << ", \"pending\": " << queueSamples[k].pending
+                << ", \"peak\": " << queueSamples[k].peak << '}';
+        }
+        out << "\n  ]}\n}\n";
+    }
+    else {
+        // One table for all three kinds of rows; the columns a kind does not use stay empty
+        out << "kind,id,name,type,evaluations,scheduled,cancelled,events,changes,time,pending,peak\n";
+        for (int gate = 0; gate < netlist.numGates(); ++gate) {
+            out << "gate," << gate << ',' << quoted(netlist.gateName(gate), '"') << ',' << quoted(netlist.typeNames[netlist.gate(gate).type()], '"')
+                << ',' << gateEvaluations[gate] << ',' << gateScheduled[gate] << ',' << gateCancelled[gate] << ",,,,,\n";
+        }
+        for (size_t signal = 0; signal < signalEvents.size(); ++signal) {
+            out << "signal," << signal << ',' << quoted(signalName(static_cast<int>(signal)), '"') << ",,,,,"
+                << signalEvents[signal] << ',' << signalChanges[signal] << ",,,\n";
+        }
+        for (const QueueSample& sample : queueSamples) {
+            out << "queue,,,,,,,,," << sample.time << ',' << sample.pending << ',' << sample.peak << '\n';
+        }
+    }
+    out.flush();
+    if (!out) {
+        cerr << "Failed to write the profile file: " << path << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef ACTIVITYPROFILE_H
+#define ACTIVITYPROFILE_H
+
+#include "Netlist.h"
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Where the work of an event-driven run goes, counted per gate and per signal while it runs
+// with --profile, plus the number of pending events sampled over simulated time
+struct ActivityProfile {
+    static const size_t MAX_SAMPLES = 1024; // Queue samples kept; beyond this every other one is dropped
+
+    // The pending events at the first timestamp of a sampling interval, and the most during it
+    struct QueueSample {
+        int time;
+        uint64_t pending;
+        uint64_t peak;
+    };
+
+    vector<uint64_t> gateEvaluations;
+    vector<uint64_t> gateScheduled; // Output changes the gate scheduled
+    vector<uint64_t> gateCancelled; // Inertial delay: of those, dropped because the output changed back first
+    vector<uint64_t> signalEvents; // Events applied to the signal, stimuli included
+    vector<uint64_t> signalChanges; // Of those, the ones that changed its value
+    vector<QueueSample> queueSamples;
+    long long sampleInterval = 1; // Simulated ns between samples; doubles each time the samples are thinned out
+    long long nextSample = 0;
+
+    void reset(int numGates, int numSignals);
+
+    // Called at the start of each timestamp with the number of events pending
+    void sampleQueue(int time, size_t pending) {
+        if (!queueSamples.empty() && time < nextSample) {
+            queueSamples.back().peak = max<uint64_t>(queueSamples.back().peak, pending);
+            return;
+        }
+        addSample(time, pending);
+    }
+
+    // Prints the 'top' gates and signals with the most activity and the totals per gate type
+    void printReport(ostream& out, const Netlist& netlist, const vector<string>& extraSignals, size_t top) const;
+
+    // Writes every count as JSON if 'path' ends in .json, otherwise as CSV
+    bool write(const string& path, const Netlist& netlist, const vector<string>& extraSignals) const;
+
+private:
+    void addSample(int time, size_t pending);
+};
+
+#endif // ACTIVITYPROFILE_H
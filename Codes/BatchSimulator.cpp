@@ -0,0 +1,393 @@
+#include "BatchSimulator.h"
+#include "Log.h"
+#include "SimulationRun.h"
+#include "TraceWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+BatchSimulator::BatchSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay,
+    const vector<uint8_t>& settledStates, const SimOptions& options)
+    : netlist(netlist), functions(functions), maxDelay(maxDelay), settledStates(settledStates), options(options) {}
+
+// One job: a fresh SimulationRun, so nothing carries over from the files simulated before it
+bool BatchSimulator::simulate(const string& stimuliFile, const string& traceFile, SimStats& runStats) const {
+    SimulationRun simulation(netlist, functions, maxDelay, settledStates, !options.transportDelay);
+    simulation.configureTrace(options.traceFormat, options.watchList);
+    if (!simulation.loadStimuli(stimuliFile)) {
+        return false;
+    }
+    bool ok = simulation.run(traceFile);
+    runStats = simulation.getStats();
+    return ok;
+}
+
+bool BatchSimulator::run(const vector<string>& stimuliFiles, int numThreads) {
+    auto start = chrono::steady_clock::now();
+    numThreads = max(1, min(numThreads, static_cast<int>(stimuliFiles.size())));
+
+    atomic<size_t> next(0);
+    mutex reportLock; // Guards 'ok', 'total' and the console
+    bool ok = true;
+    SimStats total;
+    vector<string> tracePaths = tracePathsFor(stimuliFiles, options.outputDir, options.traceFormat);
+    auto worker = [&]() {
+        for (size_t index = next++; index < stimuliFiles.size(); index = next++) {
+            const string& stimuliFile = stimuliFiles[index];
+            const string& tracePath = tracePaths[index];
+            SimStats runStats;
+            bool fileOk = simulate(stimuliFile, tracePath, runStats);
+
+            lock_guard<mutex> lock(reportLock);
+            ok = ok && fileOk;
+            total.add(runStats);
+            if (fileOk) {
+                LOG_INFO(stimuliFile << ": " << runStats.eventsProcessed << " events in "
+                    << runStats.simulateSeconds << " s, trace in " << tracePath);
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int t = 1; t < numThreads; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    total.simulateSeconds = secondsSince(start); // Wall time; the per-file times overlap
+    LOG_INFO("Batch simulation complete: " << stimuliFiles.size() << " stimuli file(s) on " << numThreads << " thread(s).");
+    if (logEnabled(LOG_LEVEL_INFO)) {
+        total.print(cout);
+    }
+    return ok;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// A client of the server. Jobs hold it until they have replied; the last one closes the socket.
+struct Connection {
+    int fd;
+    mutex writeLock;
+
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { close(fd); }
+
+    void reply(const string& line) {
+        lock_guard<mutex> lock(writeLock);
+        string text = line + '\n';
+        for (size_t sent = 0; sent < text.size();) {
+            ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL); // A vanished client must not kill the server
+            if (n <= 0) return;
+            sent += n;
+        }
+    }
+};
+
+struct Job {
+    shared_ptr<Connection> client;
+    string stimuliFile;
+    string traceFile;
+};
+
+bool makeAddress(const string& socketPath, sockaddr_un& address) {
+    address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << socketPath << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    return true;
+}
+
+// Reads lines until the peer closes its side, splitting them as they arrive
+template <typename LineHandler>
+void readLines(int fd, LineHandler handleLine) {
+    string pending;
+    char chunk[4096];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof(chunk))) > 0) {
+        pending.append(chunk, got);
+        size_t end;
+        while ((end = pending.find('\n')) != string::npos) {
+            handleLine(pending.substr(0, end));
+            pending.erase(0, end + 1);
+        }
+    }
+    if (!pending.empty()) handleLine(pending);
+}
+
+// Clears the way to bind 'socketPath' by removing the socket of a server that did not shut down
+// cleanly. Refuses to remove anything that is not a socket, or the socket of a server still running.
+bool removeStaleSocket(const string& socketPath, const sockaddr_un& address) {
+    struct stat info;
+    if (lstat(socketPath.c_str(), &info) != 0) {
+        if (errno == ENOENT) return true;
+        cerr << "Cannot use " << socketPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        cerr << socketPath << " already exists and is not a socket; not replacing it" << endl;
+        return false;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        cerr << "Failed to create a socket: " << strerror(errno) << endl;
+        return false;
+    }
+    int result = connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+    int error = errno;
+    close(probe);
+    if (result == 0) {
+        cerr << "A simulation server is already running on " << socketPath << endl;
+        return false;
+    }
+    if (error != ECONNREFUSED) { // Only a refused connection shows that no server is behind the socket
+        cerr << "Cannot tell whether a simulation server is running on " << socketPath << ": " << strerror(error) << endl;
+        return false;
+    }
+    if (unlink(socketPath.c_str()) != 0) {
+        cerr << "Failed to remove the stale socket " << socketPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    LOG_INFO("Removed the stale socket " << socketPath);
+    return true;
+}
+
+int connectTo(const string& socketPath) {
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        cerr << "Failed to connect to the simulation server at " << socketPath << ": " << strerror(errno) << endl;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends 'request', ends the connection's sending side and prints every reply line
+bool exchange(int fd, const string& request) {
+    for (size_t sent = 0; sent < request.size();) {
+        ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            cerr << "Lost the connection to the simulation server" << endl;
+            close(fd);
+            return false;
+        }
+        sent += n;
+    }
+    shutdown(fd, SHUT_WR); // Tells the server the request is complete
+
+    bool ok = true;
+    readLines(fd, [&](const string& line) {
+        cout << line << endl;
+        ok = ok && line.compare(0, 2, "ok") == 0;
+    });
+    close(fd);
+    return ok;
+}
+
+} // namespace
+
+// Accepts connections and reads their requests on this thread, waiting on all of them at once so a
+// client that has not finished its request holds up no other; a pool of workers runs the jobs.
+// A client's replies arrive in the order its jobs finish, each naming its stimuli file.
+bool BatchSimulator::serve(const string& socketPath, int numThreads) {
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address) || !removeStaleSocket(socketPath, address)) return false;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        cerr << "Failed to listen on " << socketPath << ": " << strerror(errno) << endl;
+        if (listener >= 0) close(listener);
+        return false;
+    }
+
+    deque<Job> jobs;
+    mutex jobsLock; // Guards 'jobs', 'stopping', 'total' and the console
+    condition_variable jobsReady;
+    bool stopping = false;
+    SimStats total;
+    size_t jobsRun = 0;
+
+    auto worker = [&]() {
+        for (;;) {
+            Job job;
+            {
+                unique_lock<mutex> lock(jobsLock);
+                jobsReady.wait(lock, [&] { return !jobs.empty() || stopping; });
+                if (jobs.empty()) return; // Stopping, and everything queued has run
+                job = move(jobs.front());
+                jobs.pop_front();
+            }
+
+            SimStats runStats;
+            bool ok = simulate(job.stimuliFile, job.traceFile, runStats);
+            job.client->reply(ok ? "ok " + job.stimuliFile + " " + to_string(runStats.eventsProcessed) + " events " + to_string(runStats.simulateSeconds) + " s"
+                : "error " + job.stimuliFile + ": could not be read, or its trace could not be written");
+
+            lock_guard<mutex> lock(jobsLock);
+            total.add(runStats);
+            ++jobsRun;
+            LOG_DEBUG("Served " << job.stimuliFile << " (" << runStats.eventsProcessed << " events)");
+        }
+    };
+
+    numThreads = max(1, numThreads);
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back(worker);
+    }
+    LOG_INFO("Serving " << netlist.numGates() << " gates on " << socketPath << " with " << numThreads << " thread(s).");
+
+    bool shutdownRequested = false;
+    auto handleLine = [&](const shared_ptr<Connection>& client, const string& line) {
+        if (line.empty()) return;
+        if (line == "shutdown") {
+            shutdownRequested = true;
+            client->reply("ok shutting down");
+            return;
+        }
+        size_t tab = line.find('\t');
+        if (tab == string::npos) {
+            client->reply("error expected \"<stimuli file>\\t<trace file>\", got: " + line);
+            return;
+        }
+        lock_guard<mutex> lock(jobsLock);
+        jobs.push_back({ client, line.substr(0, tab), line.substr(tab + 1) });
+        jobsReady.notify_one();
+    };
+
+    // A client whose request is still arriving: the connection and the start of a line not complete yet
+    struct Reader {
+        shared_ptr<Connection> client;
+        string pending;
+    };
+    vector<Reader> readers;
+    vector<pollfd> waiting;
+    while (!shutdownRequested) {
+        waiting.assign(1, { listener, POLLIN, 0 });
+        for (const Reader& reader : readers) {
+            waiting.push_back({ reader.client->fd, POLLIN, 0 });
+        }
+        if (poll(waiting.data(), waiting.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            cerr << "Failed to wait for the clients: " << strerror(errno) << endl;
+            break;
+        }
+
+        // Backwards, so removing a reader leaves the ones still to visit at their place in 'waiting'
+        for (size_t k = waiting.size() - 1; k > 0; --k) {
+            if (!waiting[k].revents) continue;
+            Reader& reader = readers[k - 1];
+            char chunk[4096];
+            ssize_t got = read(reader.client->fd, chunk, sizeof(chunk));
+            if (got < 0 && errno == EINTR) continue;
+            if (got > 0) {
+                reader.pending.append(chunk, got);
+                size_t end;
+                while ((end = reader.pending.find('\n')) != string::npos) {
+                    handleLine(reader.client, reader.pending.substr(0, end));
+                    reader.pending.erase(0, end + 1);
+                }
+                continue;
+            }
+            // The client closed its side: the request is complete. Its jobs keep the connection for their replies.
+            if (!reader.pending.empty()) handleLine(reader.client, reader.pending);
+            readers.erase(readers.begin() + (k - 1));
+        }
+
+        if (waiting[0].revents & POLLIN) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0) {
+                readers.push_back({ make_shared<Connection>(fd), string() });
+            }
+            else if (errno != EINTR && errno != ECONNABORTED) {
+                cerr << "Failed to accept a connection: " << strerror(errno) << endl;
+                break;
+            }
+        }
+    }
+    readers.clear(); // Requests not finished when the server stops are dropped
+
+    {
+        lock_guard<mutex> lock(jobsLock);
+        stopping = true;
+    }
+    jobsReady.notify_all();
+    for (thread& t : threads) {
+        t.join();
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+
+    LOG_INFO("Server stopped after " << jobsRun << " job(s).");
+    if (logEnabled(LOG_LEVEL_INFO)) {
+        total.print(cout);
+    }
+    return true;
+}
+
+// Paths are made absolute here, as the server may run in another folder
+bool BatchSimulator::submit(const string& socketPath, const vector<string>& stimuliFiles, const string& outputDir, TraceFormat format) {
+    vector<string> absoluteFiles;
+    for (const string& file : stimuliFiles) {
+        absoluteFiles.push_back(filesystem::absolute(file).string());
+    }
+    vector<string> tracePaths = tracePathsFor(absoluteFiles, filesystem::absolute(outputDir).string(), format);
+    string request;
+    for (size_t k = 0; k < absoluteFiles.size(); ++k) {
+        request += absoluteFiles[k] + '\t' + tracePaths[k] + '\n';
+    }
+
+    int fd = connectTo(socketPath);
+    return fd >= 0 && exchange(fd, request);
+}
+
+bool BatchSimulator::requestShutdown(const string& socketPath) {
+    int fd = connectTo(socketPath);
+    return fd >= 0 && exchange(fd, "shutdown\n");
+}
+
+#else
+
+bool BatchSimulator::serve(const string&, int) {
+    cerr << "The simulation server needs Unix domain sockets, which this platform does not provide" << endl;
+    return false;
+}
+
+bool BatchSimulator::submit(const string&, const vector<string>&, const string&, TraceFormat) {
+    cerr << "The simulation server needs Unix domain sockets, which this platform does not provide" << endl;
+    return false;
+}
+
+bool BatchSimulator::requestShutdown(const string&) {
+    cerr << "The simulation server needs Unix domain sockets, which this platform does not provide" << endl;
+    return false;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef BATCHSIMULATOR_H
+#define BATCHSIMULATOR_H
+
+#include "CompiledExpr.h"
+#include "Netlist.h"
+#include "SimOptions.h"
+#include "SimStats.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Simulates many stimuli files against one circuit loaded once. Each file is an ordinary
+// event-driven run with its own SimulationRun state, so files run side by side on a pool of
+// threads and every trace is identical to the one the event mode writes for that file.
+// The same pool can be kept alive as a local server taking jobs over a Unix socket.
+class BatchSimulator {
+public:
+    BatchSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay,
+        const vector<uint8_t>& settledStates, const SimOptions& options);
+
+    // Simulates every file on 'numThreads' threads, writing each trace to options.outputDir
+    bool run(const vector<string>& stimuliFiles, int numThreads);
+
+    // Takes jobs on 'socketPath' until a client sends "shutdown". Each request line is
+    // "<stimuli file>\t<trace file>"; each reply line starts with "ok" or "error".
+    bool serve(const string& socketPath, int numThreads);
+
+    // Sends the files to a server at 'socketPath', traces going to 'outputDir' with the extension
+    // of 'format' (the server's --trace-format decides what is written), and prints the replies
+    static bool submit(const string& socketPath, const vector<string>& stimuliFiles, const string& outputDir, TraceFormat format);
+    static bool requestShutdown(const string& socketPath);
+
+private:
+    const Netlist& netlist;
+    const vector<CompiledExpr>& functions;
+    int maxDelay;
+    const vector<uint8_t>& settledStates;
+    SimOptions options;
+
+    bool simulate(const string& stimuliFile, const string& traceFile, SimStats& runStats) const;
+};
+
+#endif // BATCHSIMULATOR_H
@@ -0,0 +1,176 @@
+#ifndef BINARYFILE_H
+#define BINARYFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// 64-bit hash of a byte stream, mixing eight bytes per step. The bytes may arrive in pieces of
+// any size: the same bytes always give the same hash.
+class ByteHash {
+public:
+    void add(const char* data, size_t size) {
+        total += size;
+        while (size > 0 && filled > 0) {
+            word[filled++] = *data++;
+            --size;
+            if (filled == 8) {
+                mixWord(word);
+                filled = 0;
+            }
+        }
+        for (; size >= 8; data += 8, size -= 8) mixWord(data);
+        memcpy(word + filled, data, size); // Either the partial word was completed above or nothing is left
+        filled += size;
+    }
+
+    uint64_t result() const {
+        uint64_t h = state ^ total * PRIME1;
+        for (size_t i = 0; i < filled; ++i) {
+            h = (h ^ static_cast<uint8_t>(word[i])) * PRIME1;
+        }
+        h ^= h >> 33;
+        return h * PRIME2;
+    }
+
+private:
+    static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t state = 0;
+    uint64_t total = 0;
+    char word[8];
+    size_t filled = 0;
+
+    void mixWord(const char* bytes) {
+        uint64_t value;
+        memcpy(&value, bytes, 8);
+        state ^= value * PRIME2;
+        state = ((state << 31) | (state >> 33)) * PRIME1;
+    }
+};
+
+// Writes plain values and arrays of them exactly as they are in memory, for files only read
+// back on the same kind of machine (the netlist cache and the run history)
+class BinaryWriter {
+public:
+    explicit BinaryWriter(const string& path) : file(path, ios_base::out | ios_base::trunc | ios_base::binary) {}
+
+    bool good() const { return file.good(); }
+
+    template <typename T>
+    void value(const T& v) {
+        static_assert(is_trivially_copyable<T>::value, "Only plain values can be written as raw bytes");
+        write(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    template <typename T>
+    void array(const vector<T>& items) {
+        static_assert(is_trivially_copyable<T>::value, "Only plain values can be written as raw bytes");
+        value<uint64_t>(items.size());
+        write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+    }
+
+    // Offset of the next byte written, to come back to with valueAt
+    streamoff position() { return file.tellp(); }
+
+    // Overwrites a value written earlier, such as a hash of what followed it
+    template <typename T>
+    void valueAt(streamoff offset, const T& v) {
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&v), sizeof(T));
+        file.seekp(0, ios_base::end);
+    }
+
+    // Hash of the bytes written since the last call to startHash
+    void startHash() { hash = ByteHash(); }
+    uint64_t hashed() const { return hash.result(); }
+
+    // All the strings' characters in one block, after their start offsets
+    void strings(const vector<string>& items) {
+        vector<uint64_t> offsets = { 0 };
+        for (const string& item : items) offsets.push_back(offsets.back() + item.size());
+        array(offsets);
+        for (const string& item : items) write(item.data(), item.size());
+    }
+
+    // Returns false if anything could not be written
+    bool close() {
+        file.close();
+        return !file.fail();
+    }
+
+private:
+    ofstream file;
+    ByteHash hash;
+
+    void write(const char* data, size_t size) {
+        file.write(data, size);
+        hash.add(data, size);
+    }
+};
+
+// Reads what BinaryWriter wrote, checking every length against the end of the file
+class BinaryReader {
+public:
+    explicit BinaryReader(string_view data) : at(data.data()), end(data.data() + data.size()) {}
+
+    bool good() const { return ok; }
+
+    // The bytes not read yet
+    string_view rest() const { return string_view(at, end - at); }
+
+    template <typename T>
+    T value() {
+        T v{};
+        if (take(sizeof(T))) memcpy(&v, at - sizeof(T), sizeof(T));
+        return v;
+    }
+
+    template <typename T>
+    void array(vector<T>& items) {
+        uint64_t count = value<uint64_t>();
+        if (!ok || count > static_cast<uint64_t>(end - at) / sizeof(T)) {
+            ok = false;
+            return;
+        }
+        items.resize(count);
+        if (take(count * sizeof(T))) memcpy(items.data(), at - count * sizeof(T), count * sizeof(T));
+    }
+
+    // The offsets must start at 0 and never decrease, so no string reaches past the characters
+    void strings(vector<string>& items) {
+        vector<uint64_t> offsets;
+        array(offsets);
+        ok = ok && !offsets.empty() && offsets.front() == 0;
+        for (size_t k = 0; ok && k + 1 < offsets.size(); ++k) {
+            ok = offsets[k] <= offsets[k + 1];
+        }
+        if (!ok || !take(offsets.back())) return;
+
+        const char* chars = at - offsets.back();
+        items.clear();
+        items.reserve(offsets.size() - 1);
+        for (size_t k = 0; k + 1 < offsets.size(); ++k) {
+            items.emplace_back(chars + offsets[k], offsets[k + 1] - offsets[k]);
+        }
+    }
+
+private:
+    const char* at;
+    const char* end;
+    bool ok = true;
+
+    bool take(uint64_t bytes) {
+        ok = ok && bytes <= static_cast<uint64_t>(end - at);
+        if (ok) at += bytes;
+        return ok;
+    }
+};
+
+#endif // BINARYFILE_H
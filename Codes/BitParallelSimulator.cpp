@@ -0,0 +1,223 @@
+#include "BitParallelSimulator.h"
+#include "InputParser.h"
+#include "Log.h"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+using namespace std;
+
+BitParallelSimulator::BitParallelSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay, const SimOptions& options)
+    : netlist(netlist), functions(functions), options(options), maxDelay(maxDelay), events(maxDelay + 1) {
+    uint32_t widest = 0;
+    for (int gate = 0; gate < netlist.numGates(); ++gate) {
+        widest = max(widest, netlist.gateInputStart[gate + 1] - netlist.gateInputStart[gate]);
+    }
+    inputWords.resize(widest);
+}
+
+// Runs the files in passes of up to 64, one lane per file
+bool BitParallelSimulator::run(const vector<string>& stimuliFiles) {
+    bool ok = true;
+    vector<string> tracePaths = tracePathsFor(stimuliFiles, options.outputDir, options.traceFormat);
+    for (size_t first = 0; first < stimuliFiles.size(); first += LANES) {
+        size_t count = min<size_t>(LANES, stimuliFiles.size() - first);
+        vector<string> passFiles(stimuliFiles.begin() + first, stimuliFiles.begin() + first + count);
+        vector<string> passTraces(tracePaths.begin() + first, tracePaths.begin() + first + count);
+        LOG_INFO("Bit-parallel pass over " << count << " stimuli file(s) starting at " << passFiles.front());
+        ok = runPass(passFiles, passTraces) && ok;
+    }
+    return ok;
+}
+
+// Returns the id of a stimulated signal, giving signals outside the circuit ids after the netlist's.
+// 'order' receives the id the scalar simulator would give the signal, which for signals outside
+// the circuit depends on where they first appear in this lane's file.
+int BitParallelSimulator::signalId(string_view name, vector<int>& laneExtraSignals, int& order) {
+    int id = netlist.findSignal(name);
+    if (id >= 0) {
+        order = id;
+        return id;
+    }
+
+    auto it = find(extraSignals.begin(), extraSignals.end(), name);
+    id = netlist.numSignals() + static_cast<int>(it - extraSignals.begin());
+    if (it == extraSignals.end()) extraSignals.emplace_back(name);
+
+    auto rank = find(laneExtraSignals.begin(), laneExtraSignals.end(), id);
+    order = netlist.numSignals() + static_cast<int>(rank - laneExtraSignals.begin());
+    if (rank == laneExtraSignals.end()) laneExtraSignals.push_back(id);
+    return id;
+}
+
+// Schedules the events of one stimuli file in its lane
+bool BitParallelSimulator::parseStim(const string& filename, int lane) {
+    uint64_t laneBit = uint64_t(1) << lane;
+    vector<int> laneExtraSignals;
+    return forEachStimulus(filename, [&](int time, string_view signal, int value) {
+        int order;
+        int id = signalId(signal, laneExtraSignals, order);
+        events.push({ time, id, value ? laneBit : 0, laneBit, order });
+    });
+}
+
+bool BitParallelSimulator::runPass(const vector<string>& files, const vector<string>& tracePaths) {
+    events = TimingWheel<LaneEvent>(maxDelay + 1);
+    extraSignals.clear();
+    traces.clear();
+
+    bool ok = true;
+    for (size_t lane = 0; lane < files.size(); ++lane) {
+        ok = parseStim(files[lane], static_cast<int>(lane)) && ok;
+    }
+
+    // Opened once every file is parsed, so the traces know the names of all the pass's signals
+    for (size_t lane = 0; lane < files.size(); ++lane) {
+        const string& tracePath = tracePaths[lane];
+        traces.push_back(make_unique<TraceWriter>(1 << 16)); // Smaller buffers: up to 64 are open at once
+        traces.back()->configure(options.traceFormat, options.watchList);
+        if (!traces.back()->open(tracePath, netlist, extraSignals)) {
+            cerr << "Failed to open .sim file for writing: " << tracePath << endl;
+            ok = false;
+        }
+    }
+
+    int numSignals = netlist.numSignals() + static_cast<int>(extraSignals.size());
+    signalStates.assign(numSignals, 0);
+    lastTraceTime.assign(numSignals, INT_MIN);
+    lastTraceValue.assign(numSignals, 0);
+    tracedLanes.assign(numSignals, 0);
+    gateDirtyLanes.assign(netlist.numGates(), 0);
+    pendingLanes.assign(netlist.numSignals(), {});
+    initializeGateOutputs();
+    for (size_t lane = 0; lane < traces.size(); ++lane) {
+        traces[lane]->writeInitialValues([&](int signal) { return static_cast<int>(signalStates[signal] >> lane & 1); });
+    }
+
+    while (!events.empty()) {
+        int time = events.popBatch(batch);
+
+        // Same order as the scalar simulator: by signal, keeping file order for repeated signals
+        stable_sort(batch.begin(), batch.end(), [](const LaneEvent& a, const LaneEvent& b) { return a.order < b.order; });
+        for (const LaneEvent& event : batch) {
+            processEvent(event);
+        }
+        evaluateDirtyGates(time);
+    }
+
+    for (size_t lane = 0; lane < traces.size(); ++lane) {
+        if (!traces[lane]->close()) {
+            cerr << "Failed to write the trace file: " << tracePaths[lane] << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Settles every lane from all-zero inputs, like GateSimulator::initializeGateOutputs
+void BitParallelSimulator::initializeGateOutputs() {
+    for (int pass = 0; pass <= netlist.numGates(); ++pass) {
+        bool changed = false;
+        for (int gate = 0; gate < netlist.numGates(); ++gate) {
+            uint64_t value = evaluateGate(gate);
+            if (signalStates[netlist.gateOutput[gate]] != value) {
+                signalStates[netlist.gateOutput[gate]] = value;
+                changed = true;
+            }
+        }
+        if (!changed) break;
+    }
+    projectedStates = signalStates;
+}
+
+uint64_t BitParallelSimulator::evaluateGate(int gate) {
+    uint32_t begin = netlist.gateInputStart[gate];
+    uint32_t end = netlist.gateInputStart[gate + 1];
+    for (uint32_t k = begin; k < end; ++k) {
+        inputWords[k - begin] = signalStates[netlist.gateInputs[k]];
+    }
+    return functions[netlist.gateFunction[gate]].evaluateWords(inputWords.data());
+}
+
+// Applies an event to its lanes, traces each lane and marks the fanout gates
+void BitParallelSimulator::processEvent(const LaneEvent& event) {
+    int signal = event.signal;
+    signalStates[signal] = (signalStates[signal] & ~event.lanes) | (event.value & event.lanes);
+
+    // A lane skips the line if it already wrote the same value for this signal at this time
+    if (lastTraceTime[signal] != event.time) {
+        lastTraceTime[signal] = event.time;
+        tracedLanes[signal] = 0;
+    }
+    uint64_t repeated = tracedLanes[signal] & ~(lastTraceValue[signal] ^ event.value);
+    uint64_t toTrace = event.lanes & ~repeated;
+    tracedLanes[signal] |= event.lanes;
+    lastTraceValue[signal] = (lastTraceValue[signal] & ~event.lanes) | (event.value & event.lanes);
+
+    while (toTrace != 0) {
+        int lane = __builtin_ctzll(toTrace);
+        toTrace &= toTrace - 1;
+        traces[lane]->write(event.time, signal, (event.value >> lane) & 1);
+    }
+
+    if (signal >= netlist.numSignals()) return; // Not part of the circuit
+    vector<PendingLanes>& pending = pendingLanes[signal];
+    pending.erase(remove_if(pending.begin(), pending.end(), [&](const PendingLanes& entry) { return entry.time <= event.time; }), pending.end());
+    for (uint32_t k = netlist.fanoutStart[signal]; k < netlist.fanoutStart[signal + 1]; ++k) {
+        int gate = netlist.fanoutGates[k];
+        if (gateDirtyLanes[gate] == 0) {
+            dirtyGates.push_back(gate);
+        }
+        gateDirtyLanes[gate] |= event.lanes;
+    }
+}
+
+// Evaluates each affected gate once for all lanes and schedules the lanes whose output changed.
+// Only lanes that saw an input event count, as the scalar simulator would not evaluate the others.
+void BitParallelSimulator::evaluateDirtyGates(int time) {
+    for (int gate : dirtyGates) {
+        uint64_t dirtyLanes = gateDirtyLanes[gate];
+        gateDirtyLanes[gate] = 0;
+        int output = netlist.gateOutput[gate];
+        uint64_t newValue = evaluateGate(gate);
+        uint64_t changed = (newValue ^ projectedStates[output]) & dirtyLanes;
+        if (!options.transportDelay) {
+            // Lanes going back to their current value before their scheduled change cancel it, as GateSimulator does
+            uint64_t cancelled = changed & ~(newValue ^ signalStates[output]);
+            if (cancelled != 0) {
+                cancelLanes(output, cancelled);
+                projectedStates[output] ^= cancelled;
+                changed &= ~cancelled;
+            }
+            if (changed != 0) pendingLanes[output].push_back({ time + netlist.gateDelay[gate], changed });
+        }
+        if (changed != 0) {
+            projectedStates[output] ^= changed;
+            events.push({ time + netlist.gateDelay[gate], output, newValue, changed, output });
+        }
+    }
+    dirtyGates.clear();
+}
+
+// Takes 'lanes' out of the scheduled events of 'signal', dropping events left with no lanes
+void BitParallelSimulator::cancelLanes(int signal, uint64_t lanes) {
+    vector<PendingLanes>& pending = pendingLanes[signal];
+    for (size_t k = 0; k < pending.size();) {
+        uint64_t hit = pending[k].lanes & lanes;
+        if (hit != 0) {
+            events.removeIf(pending[k].time, [&](LaneEvent& event) {
+                if (event.signal != signal) return false;
+                event.lanes &= ~hit;
+                return event.lanes == 0;
+            });
+            pending[k].lanes &= ~hit;
+        }
+        if (pending[k].lanes == 0) {
+            pending[k] = pending.back();
+            pending.pop_back();
+        }
+        else {
+            ++k;
+        }
+    }
+}
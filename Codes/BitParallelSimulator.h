@@ -0,0 +1,78 @@
+#ifndef BITPARALLELSIMULATOR_H
+#define BITPARALLELSIMULATOR_H
+
+#include "CompiledExpr.h"
+#include "EventQueue.h"
+#include "Netlist.h"
+#include "SimOptions.h"
+#include "TraceWriter.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// An event carrying the new value of a signal in every lane listed in 'lanes'
+struct LaneEvent {
+    int time;
+    int signal;
+    uint64_t value; // Bit j is the new value in lane j
+    uint64_t lanes; // Lanes this event applies to
+    int order; // Rank of the signal in the scalar simulator's id order for this lane
+    uint32_t sequence = 0; // Set by the queue, as for Event
+
+    bool operator>(const LaneEvent& other) const {
+        return time != other.time ? time > other.time : sequence > other.sequence;
+    }
+};
+
+// Simulates up to 64 stimuli files against one circuit in a single pass. Each signal
+// holds one 64-bit word whose bit j is its value under stimuli file j, so every gate
+// evaluation runs the compiled expression once for all files. The event semantics are the
+// same as GateSimulator's, lane by lane, and each file gets its own .sim trace.
+class BitParallelSimulator {
+public:
+    static const int LANES = 64;
+
+    BitParallelSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay, const SimOptions& options);
+
+    // Simulates every file, 64 at a time. Returns false if a file could not be read or written.
+    bool run(const vector<string>& stimuliFiles);
+
+private:
+    const Netlist& netlist;
+    const vector<CompiledExpr>& functions;
+    SimOptions options;
+    int maxDelay;
+
+    vector<string> extraSignals; // Stimulated signals the circuit does not use; ids follow the netlist's
+    vector<uint64_t> signalStates; // One word per signal, one bit per lane
+    vector<uint64_t> projectedStates; // Gate outputs once their scheduled events have happened
+    struct PendingLanes {
+        int time;
+        uint64_t lanes;
+    };
+    vector<vector<PendingLanes>> pendingLanes; // Inertial delay: per signal, when its scheduled events happen and in which lanes
+    TimingWheel<LaneEvent> events;
+    vector<LaneEvent> batch;
+    vector<int> dirtyGates;
+    vector<uint64_t> gateDirtyLanes; // Per gate, the lanes in which one of its inputs had an event
+    vector<uint64_t> inputWords; // Scratch space for gathering a gate's inputs
+
+    vector<unique_ptr<TraceWriter>> traces; // One trace per lane of the current pass
+    vector<int> lastTraceTime; // Per signal, the time of the lanes' last trace lines
+    vector<uint64_t> lastTraceValue; // Per signal, the last traced value in each lane
+    vector<uint64_t> tracedLanes; // Per signal, the lanes traced at lastTraceTime
+
+    bool runPass(const vector<string>& files, const vector<string>& tracePaths);
+    bool parseStim(const string& filename, int lane);
+    int signalId(string_view name, vector<int>& laneExtraSignals, int& order);
+    void initializeGateOutputs();
+    uint64_t evaluateGate(int gate);
+    void processEvent(const LaneEvent& event);
+    void evaluateDirtyGates(int time);
+    void cancelLanes(int signal, uint64_t lanes);
+};
+
+#endif // BITPARALLELSIMULATOR_H
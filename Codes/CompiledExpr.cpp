@@ -0,0 +1,179 @@
+#include "CompiledExpr.h"
+#include <cctype>
+#include <charconv>
+#include <vector>
+
+using namespace std;
+
+// Runs the postfix bytecode against inputs packed as bits
+int CompiledExpr::runBytecode(uint32_t packedInputs) const {
+    uint8_t evalStack[MAX_STACK];
+    int top = 0;
+
+    for (const ExprInstr& instr : code) {
+        switch (instr.op) {
+        case OP_INPUT: evalStack[top++] = (packedInputs >> instr.arg) & 1; break;
+        case OP_NOT: evalStack[top - 1] ^= 1; break;
+        case OP_AND: --top; evalStack[top - 1] &= evalStack[top]; break;
+        case OP_OR: --top; evalStack[top - 1] |= evalStack[top]; break;
+        case OP_XOR: --top; evalStack[top - 1] ^= evalStack[top]; break;
+        }
+    }
+    return top > 0 ? evalStack[top - 1] : 0;
+}
+
+// Runs the same bytecode on whole words, so each operation covers all 64 lanes
+uint64_t CompiledExpr::evaluateWords(const uint64_t* inputWords) const {
+    uint64_t evalStack[MAX_STACK];
+    int top = 0;
+
+    for (const ExprInstr& instr : code) {
+        switch (instr.op) {
+        case OP_INPUT: evalStack[top++] = inputWords[instr.arg]; break;
+        case OP_NOT: evalStack[top - 1] = ~evalStack[top - 1]; break;
+        case OP_AND: --top; evalStack[top - 1] &= evalStack[top]; break;
+        case OP_OR: --top; evalStack[top - 1] |= evalStack[top]; break;
+        case OP_XOR: --top; evalStack[top - 1] ^= evalStack[top]; break;
+        }
+    }
+    return top > 0 ? evalStack[top - 1] : 0;
+}
+
+// Binding strength of each operator; '~' is a prefix operator and binds tightest
+static int precedence(char op) {
+    switch (op) {
+    case '~': return 3;
+    case '&': return 2;
+    case '|': return 1;
+    case '^': return 1; // Same precedence as OR
+    default: return 0; // '(' never gets popped by an operator
+    }
+}
+
+static ExprOp opcodeFor(char op) {
+    switch (op) {
+    case '~': return OP_NOT;
+    case '&': return OP_AND;
+    case '|': return OP_OR;
+    default: return OP_XOR;
+    }
+}
+
+// Converts the infix expression to postfix bytecode with the shunting-yard algorithm,
+// then checks the stack discipline and tabulates small gates.
+bool compileExpression(const string& expression, int numInputs, CompiledExpr& out, string& error) {
+    out = CompiledExpr();
+    out.numInputs = numInputs;
+    if (numInputs < 0 || numInputs > 32) {
+        error = "gates must have between 0 and 32 inputs"; // Inputs are packed into 32-bit words
+        return false;
+    }
+
+    vector<char> opStack;
+    bool expectOperand = true; // True when the next token must start an operand
+
+    for (size_t i = 0; i < expression.size(); ++i) {
+        char c = expression[i];
+        if (isspace(static_cast<unsigned char>(c))) continue;
+
+        if (isalnum(static_cast<unsigned char>(c))) {
+            size_t start = i;
+            while (i + 1 < expression.size() && isalnum(static_cast<unsigned char>(expression[i + 1]))) ++i;
+            string operand = expression.substr(start, i - start + 1);
+
+            if (!expectOperand) {
+                error = "missing operator before '" + operand + "' at position " + to_string(start + 1);
+                return false;
+            }
+            bool isInput = operand.size() > 1 && operand[0] == 'i';
+            for (size_t k = 1; isInput && k < operand.size(); ++k) {
+                isInput = isdigit(static_cast<unsigned char>(operand[k])) != 0;
+            }
+            // An index too large for an int is just an unknown operand
+            int index = 0;
+            if (isInput) isInput = from_chars(operand.data() + 1, operand.data() + operand.size(), index).ec == errc();
+            if (!isInput || index < 1 || index > numInputs) {
+                error = "unknown operand '" + operand + "' at position " + to_string(start + 1);
+                return false;
+            }
+            out.code.push_back({ OP_INPUT, static_cast<uint8_t>(index - 1) });
+            expectOperand = false;
+        }
+        else if (c == '(' || c == '~') {
+            if (!expectOperand) {
+                error = string("missing operator before '") + c + "' at position " + to_string(i + 1);
+                return false;
+            }
+            opStack.push_back(c); // Prefix operators never pop anything
+        }
+        else if (c == ')') {
+            if (expectOperand) {
+                error = "missing operand before ')' at position " + to_string(i + 1);
+                return false;
+            }
+            while (!opStack.empty() && opStack.back() != '(') {
+                out.code.push_back({ opcodeFor(opStack.back()), 0 });
+                opStack.pop_back();
+            }
+            if (opStack.empty()) {
+                error = "unbalanced ')' at position " + to_string(i + 1);
+                return false;
+            }
+            opStack.pop_back(); // Removes the matching '('
+        }
+        else if (c == '&' || c == '|' || c == '^') {
+            if (expectOperand) {
+                error = string("missing operand before '") + c + "' at position " + to_string(i + 1);
+                return false;
+            }
+            while (!opStack.empty() && precedence(opStack.back()) >= precedence(c)) {
+                out.code.push_back({ opcodeFor(opStack.back()), 0 });
+                opStack.pop_back();
+            }
+            opStack.push_back(c);
+            expectOperand = true;
+        }
+        else {
+            error = string("unexpected character '") + c + "' at position " + to_string(i + 1);
+            return false;
+        }
+    }
+
+    if (expectOperand) {
+        error = "expression ends without an operand";
+        return false;
+    }
+    while (!opStack.empty()) {
+        if (opStack.back() == '(') {
+            error = "unbalanced '('";
+            return false;
+        }
+        out.code.push_back({ opcodeFor(opStack.back()), 0 });
+        opStack.pop_back();
+    }
+    return finishExpression(out, error);
+}
+
+bool finishExpression(CompiledExpr& out, string& error) {
+    // Verifies the bytecode never overflows the evaluation stack
+    int depth = 0;
+    for (const ExprInstr& instr : out.code) {
+        depth += instr.op == OP_INPUT ? 1 : (instr.op == OP_NOT ? 0 : -1);
+        if (depth > CompiledExpr::MAX_STACK) {
+            error = "expression is nested too deeply";
+            return false;
+        }
+    }
+
+    // Tabulates every input combination once so evaluation skips the bytecode
+    int numInputs = out.numInputs;
+    out.truthTable = 0;
+    out.hasTable = false;
+    if (numInputs <= CompiledExpr::MAX_TABLE_INPUTS) {
+        for (uint32_t packed = 0; packed < (1u << numInputs); ++packed) {
+            out.truthTable |= static_cast<uint64_t>(out.runBytecode(packed)) << packed;
+        }
+        out.hasTable = true;
+    }
+    return true;
+}
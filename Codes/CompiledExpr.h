@@ -0,0 +1,57 @@
+#ifndef COMPILEDEXPR_H
+#define COMPILEDEXPR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Opcodes of the postfix bytecode a library expression is compiled into
+enum ExprOp : uint8_t {
+    OP_INPUT, // Pushes input 'arg' (0-based, i1 is 0)
+    OP_NOT,
+    OP_AND,
+    OP_OR,
+    OP_XOR
+};
+
+struct ExprInstr {
+    ExprOp op;
+    uint8_t arg; // Input index for OP_INPUT, unused otherwise
+};
+
+// A library gate expression compiled once at load time. Gates with up to
+// MAX_TABLE_INPUTS inputs are also tabulated so evaluation is a single shift.
+struct CompiledExpr {
+    static const int MAX_TABLE_INPUTS = 6; // 2^6 entries fit in one 64-bit word
+    static const int MAX_STACK = 64; // Deepest operand stack an expression may need
+
+    vector<ExprInstr> code; // Postfix bytecode
+    uint64_t truthTable = 0; // Bit k holds the output for packed inputs k
+    bool hasTable = false;
+    int numInputs = 0;
+
+    // Evaluates the expression for inputs packed as bits (bit 0 is i1)
+    int evaluate(uint32_t packedInputs) const {
+        if (hasTable) {
+            return (truthTable >> packedInputs) & 1;
+        }
+        return runBytecode(packedInputs);
+    }
+
+    int runBytecode(uint32_t packedInputs) const;
+
+    // Evaluates 64 independent input vectors at once: bit j of inputWords[i] is input i in lane j
+    uint64_t evaluateWords(const uint64_t* inputWords) const;
+};
+
+// Compiles an infix library expression over i1..in into 'out'. Returns false and
+// fills 'error' if the expression is malformed or uses an unknown operand.
+bool compileExpression(const string& expression, int numInputs, CompiledExpr& out, string& error);
+
+// Checks the stack depth of the bytecode in 'out' and tabulates it if it is small enough, for
+// bytecode built directly rather than compiled from an expression
+bool finishExpression(CompiledExpr& out, string& error);
+
+#endif // COMPILEDEXPR_H
@@ -1,20 +1,28 @@
 #ifndef EVENT_H
 #define EVENT_H
 
-#include <string>
+#include <cstdint>
+#include <type_traits>
 
 using namespace std;
 
+// A scheduled change of one signal. Events are plain 16-byte records, copied with memcpy by
+// the queue and saved as they are in memory by RunHistory.
 struct Event {
     int time;
-    string signal;
+    int signal; // Signal id in the netlist
     int value;
-    Event(int t, string s, int v) : time(t), signal(s), value(v) {}
+    uint32_t sequence; // Set by the queue, to keep events with equal times in the order they were pushed
+    Event() : time(0), signal(0), value(0), sequence(0) {}
+    Event(int t, int s, int v) : time(t), signal(s), value(v), sequence(0) {}
 
-    // For priority_queue to sort events in ascending order of time
+    // For priority_queue to sort events in ascending order of time, then of sequence
     bool operator>(const Event& other) const {
-        return time > other.time;
+        return time != other.time ? time > other.time : sequence > other.sequence;
     }
 };
 
+static_assert(sizeof(Event) == 16, "Event should stay a 16-byte record");
+static_assert(is_trivially_copyable<Event>::value, "Event is copied and saved as raw bytes");
+
 #endif // EVENT_H
@@ -0,0 +1,299 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include "Event.h"
+#include <climits>
+#include <cstdint>
+#include <queue>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+// Timing-wheel scheduler. Events within 'horizon' time units of the current time go
+// into one bucket per timestamp, so inserting and popping are O(1) and every event of a
+// timestamp comes out together. Events further out (usually stimuli) wait in a min-heap
+// and move into the wheel once the current time gets close enough.
+// The wheel's events live in blocks taken from one pool and returned to it once popped, so
+// after the first few timestamps scheduling allocates nothing, and memory follows the number
+// of pending events rather than the busiest each slot has ever been.
+// EventT must be trivially copyable, with an int 'time', a uint32_t 'sequence' and an
+// operator> ordering by both, so the bit-parallel engine can reuse the wheel.
+template <typename EventT>
+class TimingWheel {
+public:
+    explicit TimingWheel(int horizon = 1024);
+
+    void push(const EventT& event);
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    // Moves every event of the earliest pending timestamp into 'batch' and returns that
+    // timestamp. Events pushed at the same timestamp while the batch is
+    // being processed come out in the next batch.
+    int popBatch(vector<EventT>& batch);
+
+    // Returns the earliest pending timestamp without removing anything, or INT_MAX if empty
+    int nextTime() const;
+
+    // Moves the current time forward to 'time', which must not be later than any pending event,
+    // so events scheduled from there on go straight into the wheel
+    void skipTo(int time);
+
+    // Calls 'visit' on each event pending at 'time' and removes those it returns true for; the
+    // others keep their order, and 'visit' may edit them. Only events within the horizon of the
+    // current time are seen, which includes every event scheduled since the last pop or skipTo.
+    template <typename Visit>
+    size_t removeIf(int time, Visit visit);
+
+    // Copies every pending event into 'out' in the order they would be popped. Pushing them
+    // into an empty wheel in that order gives back the same sequence of batches.
+    void pending(vector<EventT>& out) const;
+
+private:
+    static const int BLOCK_EVENTS = 32;
+
+    struct Block {
+        EventT events[BLOCK_EVENTS];
+        int size = 0;
+        int next = -1; // Next block of the same slot, or of the free list
+    };
+
+    vector<Block> pool;
+    int freeBlocks = -1; // Head of the list of unused blocks
+    vector<int> slotHead; // slotHead[time & mask] is the first block of the events at that time, or -1
+    vector<int> slotTail; // Only the last block of a slot can have room left
+    vector<uint64_t> occupied; // One bit per slot, set while the slot is non-empty
+    int mask;
+    int now = 0; // Wheel covers [now, now + slots)
+    bool started = false; // The wheel origin is fixed by the first pop
+    size_t count = 0;
+    uint32_t farPushed = 0; // Only events beyond the horizon get a sequence; gate events never go that far
+    priority_queue<EventT, vector<EventT>, greater<EventT>> farEvents;
+
+    int numSlots() const { return mask + 1; }
+    int allocateBlock();
+    void freeChain(int block);
+    void insertIntoWheel(const EventT& event);
+    void advanceTo(int time);
+    int findNextSlot() const;
+};
+
+using EventQueue = TimingWheel<Event>;
+
+// Rounds the horizon up to a power of two so a timestamp maps to its slot with a mask
+template <typename EventT>
+TimingWheel<EventT>::TimingWheel(int horizon) {
+    static_assert(is_trivially_copyable<EventT>::value, "TimingWheel copies events as raw bytes");
+    int size = 64;
+    while (size < horizon) size <<= 1;
+    slotHead.assign(size, -1);
+    slotTail.assign(size, -1);
+    occupied.assign(size / 64, 0);
+    mask = size - 1;
+}
+
+// Takes a block from the free list, growing the pool only when it is empty
+template <typename EventT>
+int TimingWheel<EventT>::allocateBlock() {
+    int block = freeBlocks;
+    if (block >= 0) {
+        freeBlocks = pool[block].next;
+    }
+    else {
+        block = static_cast<int>(pool.size());
+        pool.emplace_back();
+    }
+    pool[block].size = 0;
+    pool[block].next = -1;
+    return block;
+}
+
+// Returns a chain of blocks to the free list
+template <typename EventT>
+void TimingWheel<EventT>::freeChain(int block) {
+    while (block >= 0) {
+        int next = pool[block].next;
+        pool[block].next = freeBlocks;
+        freeBlocks = block;
+        block = next;
+    }
+}
+
+template <typename EventT>
+void TimingWheel<EventT>::insertIntoWheel(const EventT& event) {
+    int slot = event.time & mask;
+    int tail = slotTail[slot];
+    if (tail < 0 || pool[tail].size == BLOCK_EVENTS) {
+        int block = allocateBlock();
+        if (tail < 0) {
+            slotHead[slot] = block;
+            occupied[slot >> 6] |= uint64_t(1) << (slot & 63);
+        }
+        else {
+            pool[tail].next = block;
+        }
+        slotTail[slot] = tail = block;
+    }
+    Block& block = pool[tail];
+    block.events[block.size++] = event;
+}
+
+// Schedules an event. Before the first pop everything waits in the heap so the
+// wheel can start at the earliest time instead of at zero.
+template <typename EventT>
+void TimingWheel<EventT>::push(const EventT& event) {
+    ++count;
+    if (started && event.time < now + numSlots()) {
+        if (event.time < now) { // Never schedules into the past
+            EventT late = event;
+            late.time = now;
+            insertIntoWheel(late);
+        }
+        else {
+            insertIntoWheel(event);
+        }
+    }
+    else {
+        EventT far = event;
+        far.sequence = farPushed++;
+        farEvents.push(far);
+    }
+}
+
+// Moves the wheel origin to 'time' and pulls in far events that now fall inside it
+template <typename EventT>
+void TimingWheel<EventT>::advanceTo(int time) {
+    now = time;
+    while (!farEvents.empty() && farEvents.top().time < now + numSlots()) {
+        insertIntoWheel(farEvents.top());
+        farEvents.pop();
+    }
+}
+
+// Returns the slot of the earliest event in the wheel, or -1 if the wheel is empty
+template <typename EventT>
+int TimingWheel<EventT>::findNextSlot() const {
+    int start = now & mask;
+    int words = static_cast<int>(occupied.size());
+
+    // Scans the bitmap one word at a time starting at 'now', ending back on the first word
+    for (int i = 0; i <= words; ++i) {
+        int word = ((start >> 6) + i) % words;
+        uint64_t bits = occupied[word];
+        if (i == 0) bits &= ~uint64_t(0) << (start & 63); // Slots at or after 'now'
+        if (i == words) bits &= (uint64_t(1) << (start & 63)) - 1; // Wrapped slots before 'now'
+        if (bits != 0) {
+            return (word << 6) + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+template <typename EventT>
+int TimingWheel<EventT>::nextTime() const {
+    if (count == 0) return INT_MAX;
+    if (started) {
+        int slot = findNextSlot();
+        if (slot >= 0) return now + ((slot - (now & mask)) & mask);
+    }
+    return farEvents.top().time; // Everything pending is in the heap
+}
+
+template <typename EventT>
+int TimingWheel<EventT>::popBatch(vector<EventT>& batch) {
+    batch.clear();
+    if (count == 0) return now;
+
+    if (!started) {
+        started = true;
+        advanceTo(farEvents.top().time);
+    }
+
+    int slot = findNextSlot();
+    if (slot < 0) { // Nothing close: jump straight to the next far event
+        advanceTo(farEvents.top().time);
+        slot = findNextSlot();
+    }
+
+    int time = now + ((slot - (now & mask)) & mask);
+    advanceTo(time);
+
+    // Copies the slot's events out and gives its blocks back; 'batch' keeps its storage between calls
+    for (int block = slotHead[slot]; block >= 0; block = pool[block].next) {
+        batch.insert(batch.end(), pool[block].events, pool[block].events + pool[block].size);
+    }
+    freeChain(slotHead[slot]);
+    slotHead[slot] = slotTail[slot] = -1;
+    occupied[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+    count -= batch.size();
+    return time;
+}
+
+template <typename EventT>
+void TimingWheel<EventT>::skipTo(int time) {
+    if (!started || time > now) {
+        started = true;
+        advanceTo(time);
+    }
+}
+
+template <typename EventT>
+template <typename Visit>
+size_t TimingWheel<EventT>::removeIf(int time, Visit visit) {
+    if (!started || time < now || time >= now + numSlots()) return 0;
+    int slot = time & mask;
+    int head = slotHead[slot];
+    if (head < 0) return 0;
+
+    // Moves the kept events forward over the removed ones, block by block
+    int writeBlock = head;
+    int written = 0;
+    size_t removed = 0;
+    for (int block = head; block >= 0; block = pool[block].next) {
+        for (int k = 0; k < pool[block].size; ++k) {
+            if (visit(pool[block].events[k])) {
+                ++removed;
+                continue;
+            }
+            if (written == BLOCK_EVENTS) {
+                writeBlock = pool[writeBlock].next;
+                written = 0;
+            }
+            pool[writeBlock].events[written++] = pool[block].events[k];
+        }
+    }
+    if (removed == 0) return 0;
+    count -= removed;
+
+    if (written == 0) { // Nothing kept
+        freeChain(head);
+        slotHead[slot] = slotTail[slot] = -1;
+        occupied[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+    }
+    else {
+        freeChain(pool[writeBlock].next);
+        pool[writeBlock].size = written;
+        pool[writeBlock].next = -1;
+        slotTail[slot] = writeBlock;
+    }
+    return removed;
+}
+
+template <typename EventT>
+void TimingWheel<EventT>::pending(vector<EventT>& out) const {
+    out.clear();
+    if (started) {
+        for (int i = 0; i < numSlots(); ++i) { // The wheel holds times [now, now + slots) in slot order from 'now'
+            for (int block = slotHead[(now + i) & mask]; block >= 0; block = pool[block].next) {
+                out.insert(out.end(), pool[block].events, pool[block].events + pool[block].size);
+            }
+        }
+    }
+    auto far = farEvents;
+    for (; !far.empty(); far.pop()) {
+        out.push_back(far.top());
+    }
+}
+
+#endif // EVENTQUEUE_H
@@ -0,0 +1,297 @@
+#include "FaultSimulator.h"
+#include "InputParser.h"
+#include "LevelizedSimulator.h"
+#include "Log.h"
+#include "SimStats.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+FaultSimulator::FaultSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, const SimOptions& options)
+    : netlist(netlist), functions(functions), options(options) {}
+
+bool FaultSimulator::levelize() {
+    vector<int> gateOrder, gateLevel, loopGates;
+    if (!levelizeNetlist(netlist, gateOrder, gateLevel, loopGates)) {
+        cerr << "Combinational loop through gate(s):";
+        for (int gate : loopGates) {
+            cerr << " " << netlist.gateName(gate);
+        }
+        cerr << endl;
+        return false;
+    }
+
+    orderedFunction.clear();
+    orderedOutput.clear();
+    orderedInputs.clear();
+    orderedInputStart.assign(1, 0);
+    for (int gate : gateOrder) {
+        orderedFunction.push_back(netlist.gateFunction[gate]);
+        orderedOutput.push_back(netlist.gateOutput[gate]);
+        for (uint32_t k = netlist.gateInputStart[gate]; k < netlist.gateInputStart[gate + 1]; ++k) {
+            orderedInputs.push_back(netlist.gateInputs[k]);
+        }
+        orderedInputStart.push_back(static_cast<uint32_t>(orderedInputs.size()));
+        widestGate = max(widestGate, netlist.gateInputStart[gate + 1] - netlist.gateInputStart[gate]);
+    }
+
+    // Which gates to mark when a signal, or the fault on it, changes
+    int numSignals = netlist.numSignals();
+    int numGates = static_cast<int>(orderedOutput.size());
+    readerStart.assign(numSignals + 1, 0);
+    driverStart.assign(numSignals + 1, 0);
+    for (int i = 0; i < numGates; ++i) {
+        ++driverStart[orderedOutput[i] + 1];
+        for (uint32_t k = orderedInputStart[i]; k < orderedInputStart[i + 1]; ++k) ++readerStart[orderedInputs[k] + 1];
+    }
+    for (int signal = 0; signal < numSignals; ++signal) {
+        readerStart[signal + 1] += readerStart[signal];
+        driverStart[signal + 1] += driverStart[signal];
+    }
+    readers.resize(readerStart.back());
+    drivers.resize(driverStart.back());
+    vector<uint32_t> nextReader(readerStart.begin(), readerStart.end() - 1), nextDriver(driverStart.begin(), driverStart.end() - 1);
+    for (int i = 0; i < numGates; ++i) {
+        drivers[nextDriver[orderedOutput[i]]++] = i;
+        for (uint32_t k = orderedInputStart[i]; k < orderedInputStart[i + 1]; ++k) readers[nextReader[orderedInputs[k]]++] = i;
+    }
+
+    findPrimaryOutputs(netlist, primaryOutputs);
+    vector<uint8_t> driven(netlist.numSignals(), 0);
+    for (int output : netlist.gateOutput) driven[output] = 1;
+    primaryInputs.clear();
+    for (int signal = 0; signal < netlist.numSignals(); ++signal) {
+        if (!driven[signal]) primaryInputs.push_back(signal);
+    }
+    return true;
+}
+
+// Reads the stimuli like LevelizedSimulator: only primary inputs can be driven. Each signal that
+// cannot be is reported once, at its first stimulus.
+bool FaultSimulator::loadStimuli(const string& stimuliFile) {
+    vector<uint8_t> driven(netlist.numSignals(), 0);
+    for (int output : netlist.gateOutput) driven[output] = 1;
+    vector<uint8_t> reported(netlist.numSignals(), 0);
+    vector<string> unknownSignals;
+
+    bool parsed = forEachStimulus(stimuliFile, [&](int time, string_view signal, int value) {
+        int id = netlist.findSignal(signal);
+        if (id < 0) {
+            if (find(unknownSignals.begin(), unknownSignals.end(), signal) == unknownSignals.end()) {
+                unknownSignals.emplace_back(signal);
+                cerr << "Ignoring the stimuli on " << signal << " from time " << time << ": unknown signal" << endl;
+            }
+            return;
+        }
+        if (driven[id]) {
+            if (!reported[id]) {
+                cerr << "Ignoring the stimuli on " << signal << " from time " << time
+                    << ": only primary inputs can be driven in fault mode" << endl;
+                reported[id] = 1;
+            }
+            return;
+        }
+        stimuli.push_back({ time, id, value });
+    });
+    stable_sort(stimuli.begin(), stimuli.end(), [](const Stimulus& a, const Stimulus& b) { return a.time < b.time; });
+
+    pointStart.assign(1, 0);
+    for (size_t k = 1; k <= stimuli.size(); ++k) {
+        if (k == stimuli.size() || stimuli[k].time != stimuli[k - 1].time) {
+            pointStart.push_back(static_cast<uint32_t>(k));
+        }
+    }
+    return parsed;
+}
+
+void FaultSimulator::initLanes(Lanes& lanes) const {
+    int numSignals = netlist.numSignals();
+    size_t numGates = orderedOutput.size();
+    lanes.values.assign(numSignals, 0);
+    lanes.stuckAnd.assign(numSignals, ~uint64_t(0));
+    lanes.stuckOr.assign(numSignals, 0);
+    lanes.dirty.assign((numGates + 63) / 64, ~uint64_t(0)); // The first sweep evaluates every gate
+    if (numGates % 64 != 0) lanes.dirty.back() = (uint64_t(1) << (numGates % 64)) - 1;
+    lanes.inputWords.resize(widestGate);
+}
+
+// Gives a signal a new value, forced to the stuck value in its faulty lanes, and marks its readers
+void FaultSimulator::setSignal(Lanes& lanes, int signal, uint64_t value) const {
+    value = (value & lanes.stuckAnd[signal]) | lanes.stuckOr[signal];
+    if (lanes.values[signal] == value) return;
+    lanes.values[signal] = value;
+    for (uint32_t k = readerStart[signal]; k < readerStart[signal + 1]; ++k) {
+        lanes.dirty[readers[k] >> 6] |= uint64_t(1) << (readers[k] & 63);
+    }
+}
+
+// Changes which lanes have 'signal' stuck; its drivers recompute it at the next sweep, while
+// primary inputs are set again at every time point
+void FaultSimulator::setStuck(Lanes& lanes, int signal, uint64_t stuckAnd, uint64_t stuckOr) const {
+    lanes.stuckAnd[signal] = stuckAnd;
+    lanes.stuckOr[signal] = stuckOr;
+    for (uint32_t k = driverStart[signal]; k < driverStart[signal + 1]; ++k) {
+        lanes.dirty[drivers[k] >> 6] |= uint64_t(1) << (drivers[k] & 63);
+    }
+}
+
+// Evaluates the marked gates in level order for all lanes. A gate only marks gates after it,
+// so one pass over the bitmap reaches everything a change affects.
+void FaultSimulator::sweep(Lanes& lanes) const {
+    for (size_t word = 0; word < lanes.dirty.size(); ++word) {
+        while (lanes.dirty[word] != 0) {
+            int i = static_cast<int>(word << 6) + __builtin_ctzll(lanes.dirty[word]);
+            lanes.dirty[word] &= lanes.dirty[word] - 1;
+
+            uint32_t begin = orderedInputStart[i];
+            for (uint32_t k = begin; k < orderedInputStart[i + 1]; ++k) {
+                lanes.inputWords[k - begin] = lanes.values[orderedInputs[k]];
+            }
+            int output = orderedOutput[i];
+            setSignal(lanes, output, functions[orderedFunction[i]].evaluateWords(lanes.inputWords.data()));
+
+            // With several drivers the last one in level order wins, as in a full sweep
+            for (uint32_t k = driverStart[output]; k < driverStart[output + 1]; ++k) {
+                if (drivers[k] > i) lanes.dirty[drivers[k] >> 6] |= uint64_t(1) << (drivers[k] & 63);
+            }
+        }
+    }
+}
+
+// Records the primary outputs of the circuit without faults after each time point
+void FaultSimulator::simulateFaultFree() {
+    size_t numPoints = pointStart.size() - 1;
+    Lanes lanes;
+    initLanes(lanes);
+
+    outputWords = (primaryOutputs.size() + 63) / 64;
+    goodOutputs.assign(numPoints * outputWords, 0);
+    for (size_t point = 0; point < numPoints; ++point) {
+        for (uint32_t k = pointStart[point]; k < pointStart[point + 1]; ++k) {
+            setSignal(lanes, stimuli[k].signal, stimuli[k].value ? ~uint64_t(0) : 0);
+        }
+        sweep(lanes);
+        for (size_t k = 0; k < primaryOutputs.size(); ++k) {
+            goodOutputs[point * outputWords + (k >> 6)] |= (lanes.values[primaryOutputs[k]] & 1) << (k & 63);
+        }
+    }
+}
+
+// One thread's share: keeps 64 faults in flight, taking the next one from 'nextFault'
+// whenever a lane's fault is detected or has been through every time point
+void FaultSimulator::worker(atomic<int>& nextFault) {
+    int numSignals = netlist.numSignals();
+    int numFaults = 2 * numSignals;
+    size_t numPoints = pointStart.size() - 1;
+    Lanes lanes;
+    initLanes(lanes);
+    vector<uint8_t> inputs(numSignals, 0); // Fault-free value of each primary input at the current time point
+    int laneFault[LANES];
+    size_t laneStart[LANES]; // Time point the lane's fault started at
+    uint64_t active = 0;
+
+    auto claim = [&](int lane, size_t point) {
+        int fault = nextFault.fetch_add(1);
+        if (fault >= numFaults) return;
+        int signal = fault / 2;
+        uint64_t bit = uint64_t(1) << lane;
+        if (fault % 2 == 0) {
+            setStuck(lanes, signal, lanes.stuckAnd[signal] & ~bit, lanes.stuckOr[signal]);
+        }
+        else {
+            setStuck(lanes, signal, lanes.stuckAnd[signal], lanes.stuckOr[signal] | bit);
+        }
+        laneFault[lane] = fault;
+        laneStart[lane] = point;
+        active |= bit;
+    };
+    auto release = [&](int lane) {
+        int signal = laneFault[lane] / 2;
+        uint64_t bit = uint64_t(1) << lane;
+        setStuck(lanes, signal, lanes.stuckAnd[signal] | bit, lanes.stuckOr[signal] & ~bit);
+        active &= ~bit;
+    };
+
+    for (int lane = 0; lane < LANES; ++lane) {
+        claim(lane, 0);
+    }
+    for (size_t point = 0; active != 0;) {
+        if (point == 0) {
+            for (int signal : primaryInputs) inputs[signal] = 0; // Every pass over the time points starts from zero inputs
+        }
+        for (uint32_t k = pointStart[point]; k < pointStart[point + 1]; ++k) {
+            inputs[stimuli[k].signal] = static_cast<uint8_t>(stimuli[k].value);
+        }
+        for (int signal : primaryInputs) {
+            setSignal(lanes, signal, inputs[signal] ? ~uint64_t(0) : 0);
+        }
+        sweep(lanes);
+
+        uint64_t differs = 0;
+        const uint64_t* good = &goodOutputs[point * outputWords];
+        for (size_t k = 0; k < primaryOutputs.size(); ++k) {
+            uint64_t expected = (good[k >> 6] >> (k & 63)) & 1 ? ~uint64_t(0) : 0;
+            differs |= lanes.values[primaryOutputs[k]] ^ expected;
+        }
+        point = point + 1 == numPoints ? 0 : point + 1;
+
+        // Detected faults are dropped; a fault back at its first time point has seen them all
+        for (uint64_t remaining = active; remaining != 0; remaining &= remaining - 1) {
+            int lane = __builtin_ctzll(remaining);
+            bool found = (differs >> lane) & 1;
+            if (!found && laneStart[lane] != point) continue;
+            if (found) detected[laneFault[lane]] = 1;
+            release(lane);
+            claim(lane, point);
+        }
+    }
+}
+
+bool FaultSimulator::run(int numThreads) {
+    auto start = chrono::steady_clock::now();
+    int numFaults = 2 * netlist.numSignals();
+    size_t numPoints = pointStart.size() - 1;
+    detected.assign(numFaults, 0);
+
+    if (numPoints > 0) {
+        simulateFaultFree();
+        atomic<int> nextFault(0);
+        int workers = max(1, min(numThreads, (numFaults + LANES - 1) / LANES));
+        vector<thread> threads;
+        for (int index = 1; index < workers; ++index) {
+            threads.emplace_back(&FaultSimulator::worker, this, ref(nextFault));
+        }
+        worker(nextFault);
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+
+    ofstream report(options.outputFile);
+    if (!report.is_open()) {
+        cerr << "Failed to open the fault report for writing: " << options.outputFile << endl;
+        return false;
+    }
+    int found = 0;
+    for (int fault = 0; fault < numFaults; ++fault) {
+        if (detected[fault]) {
+            ++found;
+        }
+        else {
+            report << netlist.signalName(fault / 2) << ", stuck-at-" << fault % 2 << '\n';
+        }
+    }
+    report.close();
+
+    LOG_INFO("Fault simulation complete: " << orderedOutput.size() << " gates, " << numPoints << " time points, "
+        << secondsSince(start) << " s.");
+    cout << "Faults: " << numFaults << ", detected: " << found << ", undetected: " << numFaults - found
+        << " (listed in " << options.outputFile << ")" << endl;
+    cout << "Fault coverage: " << fixed << setprecision(2) << (numFaults > 0 ? 100.0 * found / numFaults : 0.0) << "%" << endl;
+    return true;
+}
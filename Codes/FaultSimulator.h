@@ -0,0 +1,83 @@
+#ifndef FAULTSIMULATOR_H
+#define FAULTSIMULATOR_H
+
+#include "CompiledExpr.h"
+#include "Netlist.h"
+#include "SimOptions.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Stuck-at fault simulation, to measure how many faults a stimuli file detects. Every signal
+// of the netlist can be stuck at 0 or at 1. Each of the 64 bits of a signal word simulates the
+// circuit with one fault in place, with the zero-delay level-order sweep of LevelizedSimulator,
+// and a fault is detected when a primary output differs from the fault-free circuit after a
+// stimulus time point. Only gates with an input that changed since the last sweep are evaluated.
+// A detected fault is dropped at once and its lane takes the next fault: the circuit is
+// combinational, so that fault can start at any time point and go round them all.
+class FaultSimulator {
+public:
+    static const int LANES = 64;
+
+    FaultSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, const SimOptions& options);
+
+    // Orders the gates by level. Returns false if the circuit contains a combinational loop.
+    bool levelize();
+
+    bool loadStimuli(const string& stimuliFile);
+
+    // Simulates every fault on up to 'numThreads' threads, prints the coverage and writes the
+    // undetected faults to the output file
+    bool run(int numThreads);
+
+private:
+    struct Stimulus {
+        int time;
+        int signal;
+        int value;
+    };
+
+    // The signal words of one thread's 64 lanes
+    struct Lanes {
+        vector<uint64_t> values;
+        vector<uint64_t> stuckAnd; // Per signal, clear in the lanes where it is stuck at 0
+        vector<uint64_t> stuckOr; // Per signal, set in the lanes where it is stuck at 1
+        vector<uint64_t> dirty; // One bit per gate in level order, set if it needs evaluating
+        vector<uint64_t> inputWords; // Scratch space for gathering a gate's inputs
+    };
+
+    const Netlist& netlist;
+    const vector<CompiledExpr>& functions;
+    SimOptions options;
+
+    // The gates in level order, laid out so the sweep reads them front to back
+    vector<int> orderedFunction;
+    vector<int> orderedOutput;
+    vector<uint32_t> orderedInputStart;
+    vector<int> orderedInputs;
+    uint32_t widestGate = 0;
+    vector<uint32_t> readerStart; // Per signal, the level-order indices of the gates reading it (CSR)
+    vector<int> readers;
+    vector<uint32_t> driverStart; // Per signal, the level-order indices of the gates driving it (CSR)
+    vector<int> drivers;
+    vector<int> primaryInputs; // Signals no gate drives
+    vector<int> primaryOutputs;
+
+    vector<Stimulus> stimuli; // Sorted by time
+    vector<uint32_t> pointStart; // Stimuli of each time point (CSR)
+    vector<uint64_t> goodOutputs; // Per time point, the fault-free primary outputs, one bit each
+    size_t outputWords = 0;
+    vector<uint8_t> detected; // Per fault: 2 * signal + stuck value
+
+    void initLanes(Lanes& lanes) const;
+    void setSignal(Lanes& lanes, int signal, uint64_t value) const;
+    void setStuck(Lanes& lanes, int signal, uint64_t stuckAnd, uint64_t stuckOr) const;
+    void sweep(Lanes& lanes) const;
+    void simulateFaultFree();
+    void worker(atomic<int>& nextFault);
+};
+
+#endif // FAULTSIMULATOR_H
@@ -5,24 +5,22 @@
 #include <string>
 #include <vector>
 #include <iostream>
-#include <unordered_map>
 
 using namespace std;
 
+// A gate type parsed from the library file. Circuit gate instances live in the Netlist.
 struct Gate {
     string type;
     vector<string> inputs;
     string output; // Output signal name
     string outputExpr; // Logical expression for output
     int delay;
+    int function; // Index of the compiled library expression in GateSimulator::functions
 
     // Constructor is not necessary but helpful for initializing Gate objects cleanly
-    Gate(string t = "", vector<string> i = {}, string o = "", string oe = "", int d = 0)
-        : type(t), inputs(i), output(o), outputExpr(oe), delay(d) {}
+    Gate(string t = "", vector<string> i = {}, string o = "", string oe = "", int d = 0, int f = -1)
+        : type(t), inputs(i), output(o), outputExpr(oe), delay(d), function(f) {}
 };
 
-extern unordered_map<string, Gate> gates;
-extern unordered_map<string, vector<string>> signalToGates;
-
 
 #endif // GATE_H
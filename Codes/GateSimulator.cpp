@@ -1,80 +1,212 @@
 #include "GateSimulator.h"
 #include "Gate.h"
 #include "Event.h"
+#include "Log.h"
+#include "LevelizedSimulator.h"
+#include "NetlistCache.h"
+#include "TraceWriter.h"
 #include <fstream>
-#include <stack>
 #include <vector>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <set>
+#include <climits>
 
 using namespace std;
 
-// This comparator sorts events based on their 'time' attribute,
-// ensuring the event with the latest time is at the top of the queue.
-auto eventCompare = [](const Event& a, const Event& b) { return a.time < b.time; };
-
-// Initialize a priority queue 'events' to store Event objects, sorted according to the 
-// 'eventCompare' comparator.
-priority_queue<Event, vector<Event>, decltype(eventCompare)> events(eventCompare);
 
+// Constructor for the GateSimulator class: Initializes the simulator by parsing input files and setting up gate outputs.
+GateSimulator::GateSimulator(const string& libraryFile, const string& circuitFile, const string& stimuliFile, const SimOptions& options)
+    : GateSimulator(libraryFile, circuitFile, options) {
+    LOG_INFO("Parsing Stimuli File..."); // Notify the user that the parsing of the stimuli file is starting.
+    auto start = chrono::steady_clock::now();
+    if (options.optimize) {
+        if (!options.historyFile.empty()) {
+            LOG_WARN("--optimize changes the netlist the --history checkpoints were taken on; simulating without it");
+        }
+        else {
+            optimize(stimuliFile, false);
+        }
+    }
+    simulation = make_unique<SimulationRun>(netlist, functions, getMaxDelay(), signalStates, !options.transportDelay);
+    simulation->loadStimuli(stimuliFile); // Parses the stimuli file to prepare the initial set of inputs for simulation.
+    simulation->countSavedEvents(optimized.mirroredSignals);
+    simulation->configureTrace(options.traceFormat, options.watchList);
+    if (!options.historyFile.empty()) {
+        if (options.traceFormat != TraceFormat::Text || !options.watchList.empty()) {
+            LOG_WARN("--history needs a text trace of every signal; simulating without it");
+        }
+        else if (!options.profileFile.empty()) {
+            LOG_WARN("--profile has to count every event, but --history copies part of the run from the last one; simulating without the history");
+        }
+        else {
+            simulation->enableHistory(options.historyFile, libraryHash, circuitHash, options.checkpointEvents);
+        }
+    }
+    if (!options.profileFile.empty()) {
+        simulation->enableProfile();
+    }
+    stats.parseSeconds += secondsSince(start);
 
-unordered_map<string, Gate> gates;
-unordered_map<string, vector<string>> signalToGates;
-unordered_map<string, int> signalStates; // Assuming this is declared somewhere
+    if (logEnabled(LOG_LEVEL_DEBUG)) {
+        printParsedCircuitGates(); // Prints the gates of the parsed circuit for verification and debugging purposes.
+    }
 
-// Constructor for the GateSimulator class: Initializes the simulator by parsing input files and setting up gate outputs.
-GateSimulator::GateSimulator(const string& libraryFile, const string& circuitFile, const string& stimuliFile) {
-    cout << "Parsing Library File...\n"; // Notify the user that the parsing of the library file is starting.
-    parseLib(libraryFile);
+    LOG_INFO("Initialization Complete."); // Indicates to the user that the initialization process is complete.
+}
 
-    cout << "Parsing Circuit File...\n";// Notify the user that the parsing of the circuit file is starting.
-    parseCir(circuitFile); // Parses the circuit file to build the internal representation of the circuit.
+// Loads the library and circuit without any stimuli, for engines that bring their own
+GateSimulator::GateSimulator(const string& libraryFile, const string& circuitFile, const SimOptions& options)
+    : options(options) {
+    auto start = chrono::steady_clock::now();
+    bool hashed = (!options.cacheFile.empty() || !options.historyFile.empty())
+        && hashFileContents(libraryFile, libraryHash) && hashFileContents(circuitFile, circuitHash);
+    bool cacheable = hashed && !options.cacheFile.empty();
+    LoadedCircuit loaded{ libraryGates, functions, netlist, signalStates };
+    if (cacheable && loadNetlistCache(options.cacheFile, libraryHash, circuitHash, loaded)) {
+        stats.parseSeconds += secondsSince(start);
+        LOG_INFO("Loaded " << netlist.numGates() << " gates from the netlist cache " << options.cacheFile);
+        return; // The cache holds the settled gate outputs too
+    }
 
-    cout << "Parsing Stimuli File...\n";// Notify the user that the parsing of the stimuli file is starting.
-    parseStim(stimuliFile); // Parses the stimuli file to prepare the initial set of inputs for simulation.
+    LOG_INFO("Parsing Library File..."); // Notify the user that the parsing of the library file is starting.
+    bool clean = parseLib(libraryFile);
 
+    LOG_INFO("Parsing Circuit File..."); // Notify the user that the parsing of the circuit file is starting.
+    clean = parseCir(circuitFile) && clean; // Parses the circuit file to build the internal representation of the circuit.
+    stats.parseSeconds += secondsSince(start);
 
+    start = chrono::steady_clock::now();
     initializeGateOutputs(); // Initializes the outputs of the gates based on the initial simulation state.
-    printParsedCircuitGates(); // Prints the gates of the parsed circuit for verification and debugging purposes.
+    stats.initSeconds += secondsSince(start);
 
-    cout << "Initialization Complete.\n"; // Indicates to the user that the initialization process is complete.
+    // Files with errors are not cached, so the errors are reported again on the next run
+    if (cacheable && clean) {
+        if (saveNetlistCache(options.cacheFile, libraryHash, circuitHash, loaded)) {
+            LOG_INFO("Wrote the netlist cache " << options.cacheFile);
+        }
+        else {
+            LOG_WARN("Failed to write the netlist cache " << options.cacheFile);
+        }
+    }
+}
+
+// Works out which signals the stimuli drive and which the trace shows, then lets optimizeNetlist
+// drop or merge the gates that cannot change what it shows. 'zeroDelay' is for the levelized
+// mode, whose trace holds only the primary outputs after each time point.
+void GateSimulator::optimize(const string& stimuliFile, bool zeroDelay) {
+    auto start = chrono::steady_clock::now();
+    netlist.expandInstances(); // The optimizer rewrites the gates one by one
+    OptimizeScope scope;
+    scope.zeroDelay = zeroDelay;
+    scope.transportDelay = options.transportDelay;
+    scope.stimulated.assign(netlist.numSignals(), 0);
+    forEachStimulus(stimuliFile, [&](int, string_view signal, int) {
+        int id = netlist.findSignal(signal);
+        if (id >= 0) scope.stimulated[id] = 1;
+    }); // Errors are reported when the simulation reads the file
+
+    scope.observed.assign(netlist.numSignals(), options.watchList.empty());
+    for (int signal = 0; signal < netlist.numSignals() && !options.watchList.empty(); ++signal) {
+        string name = netlist.signalName(signal);
+        for (size_t k = 0; k < options.watchList.size() && !scope.observed[signal]; ++k) {
+            scope.observed[signal] = matchesPattern(options.watchList[k], name);
+        }
+    }
+    if (zeroDelay) {
+        vector<int> primaryOutputs;
+        findPrimaryOutputs(netlist, primaryOutputs);
+        vector<uint8_t> written(netlist.numSignals(), 0);
+        for (int output : primaryOutputs) written[output] = 1;
+        for (int signal = 0; signal < netlist.numSignals(); ++signal) {
+            scope.observed[signal] = scope.observed[signal] && written[signal];
+        }
+    }
+
+    optimized = optimizeNetlist(netlist, functions, signalStates, scope);
+    stats.initSeconds += secondsSince(start);
+    if (zeroDelay && logEnabled(LOG_LEVEL_INFO)) {
+        optimized.print(cout); // Events are not counted without delays
+    }
+}
+
+// Prints the summary of optimize once a run with gate delays has counted the events it saved
+void GateSimulator::reportOptimization(const SimStats& runStats) {
+    optimized.eventsSaved = runStats.eventsSaved;
+    optimized.eventsCounted = true;
+    if (logEnabled(LOG_LEVEL_INFO)) {
+        optimized.print(cout);
+    }
+}
+
+// Returns the longest delay of any library gate
+int GateSimulator::getMaxDelay() const {
+    int maxDelay = 0;
+    for (const auto& [name, gate] : libraryGates) {
+        maxDelay = max(maxDelay, gate.delay);
+    }
+    return maxDelay;
 }
 
 
 // // Initializes the output states of all gates in the circuit based on their logical expressions and initial input states.
 void GateSimulator::initializeGateOutputs() {
-    cout << "Initializing gate outputs based on initial states...\n"; // Logs the start of gate output initialization.
-    for (auto& [gateName, gate] : gates) { // Iterates over all gates in the circuit.
-        int initOutputValue = evaluateExpression(gate.outputExpr, gate.inputs);
-        signalStates[gate.output] = initOutputValue; //Updates the state of the gate's output signal in the signalStates map with the calculated initial value. 
+    LOG_INFO("Initializing gate outputs based on initial states..."); // Logs the start of gate output initialization.
+    // Re-evaluates all gates until no output changes, so the circuit starts in a settled state
+    int pass = 0;
+    for (; pass <= netlist.numGates(); ++pass) {
+        bool changed = false;
+        netlist.forEachGate([&](int, const Netlist::GateView& view) { // Iterates over all gates in the circuit.
+            int initOutputValue = computeGateOutput(functions, signalStates, view);
+            if (signalStates[view.output()] != initOutputValue) {
+                signalStates[view.output()] = initOutputValue; //Updates the state of the gate's output signal with the calculated initial value. 
+                changed = true;
+            }
+        });
+        if (!changed) break;
+    }
+    if (pass > netlist.numGates()) {
+        LOG_WARN("Gate outputs did not settle during initialization; the circuit contains an oscillating loop.");
     }
 }
 
 // Begins the simulation process, processes all scheduled events, and finalizes output.
-void GateSimulator::startSimulation() {
-    cout << "Simulation starting. Total initial events: " << events.size() << endl; // Logs the start of the simulation and the initial number of events.
+// Returns false if the trace could not be written.
+bool GateSimulator::startSimulation() {
+    if (!simulation) return false; // Loaded without a stimuli file
 
-    while (!events.empty()) { // Continues processing as long as there are events in the priority queue.
-        Event currentEvent = events.top();
-        events.pop();
-        processEvents(currentEvent);
+    LOG_INFO("Simulation starting. Total initial events: " << simulation->pendingEvents()); // Logs the start of the simulation and the initial number of events.
+    bool ok = simulation->run(options.outputFile);
+    stats.add(simulation->getStats());
+
+    LOG_INFO("Simulation complete. No more events to process.");
+    if (options.optimize && options.historyFile.empty()) {
+        reportOptimization(stats);
+    }
+
+    if (logEnabled(LOG_LEVEL_INFO)) {
+        stats.print(cout);
     }
 
-    cout << "Simulation complete. No more events to process." << endl;
-    sortAndClean("output.sim"); //Cleans and sorts the final output, then writes it to a file 
+    if (const ActivityProfile* profile = simulation->getProfile()) {
+        if (logEnabled(LOG_LEVEL_INFO)) {
+            profile->printReport(cout, netlist, simulation->getExtraSignals(), options.profileTop);
+        }
+        profile->write(options.profileFile, netlist, simulation->getExtraSignals());
+    }
+    return ok;
 }
 
 // Displays the initial state of all signals and the configuration of all gates before simulation starts
 void GateSimulator::printInitialState() {
     cout << "Initial State:" << endl;
-    for (const auto& [signal, value] : signalStates) {
-        cout << "Signal " << signal << " = " << value << endl;
+    for (int signal = 0; signal < netlist.numSignals(); ++signal) {
+        cout << "Signal " << netlist.signalName(signal) << " = " << int(signalStates[signal]) << endl;
     }
     cout << "Gates:" << endl;
-    for (const auto& [name, gate] : gates) {
-        cout << "Gate " << name << " with output " << gate.output << endl; //Prints each gate's name and its initial output state
+    for (int gate = 0; gate < netlist.numGates(); ++gate) {
+        cout << "Gate " << netlist.gateName(gate) << " with output " << netlist.signalName(netlist.gate(gate).output()) << endl; //Prints each gate's name and its initial output state
     }
 }
 
@@ -102,15 +234,18 @@ string GateSimulator::adaptExpression(const string& expression, const vector<str
 }
 
 // Parses the library file to build a map of gate types available for the simulation, including their characteristics
-void GateSimulator::parseLib(const string& filename) {
+bool GateSimulator::parseLib(const string& filename) {
     ifstream file(filename);
     if (!file.is_open()) {
         cerr << "Failed to open library file: " << filename << endl;
-        return;
+        return false;
     }
 
+    bool ok = true; // Every gate type compiled
     string line; //Variable to hold each line read from the file
     while (getline(file, line)) {
+        if (line.find_first_not_of(" \t\r") == string::npos) continue; // Blank lines are skipped, as in the circuit file
+
         istringstream ss(line);
         string componentName, token;
         int numOfInputs, delay;
@@ -123,323 +258,234 @@ void GateSimulator::parseLib(const string& filename) {
         getline(ss, outputExpr, ',');
         ss >> delay;
 
+        // Compiles the expression once so simulation never re-parses it
+        CompiledExpr compiled;
+        string error;
+        if (!compileExpression(outputExpr, numOfInputs, compiled, error)) {
+            cerr << "Invalid expression for gate " << componentName << ": " << error << endl;
+            ok = false;
+            continue;
+        }
+        functions.push_back(move(compiled));
+
         // Stores the gate definition in the libraryGates map with its characteristics
-        libraryGates[componentName] = Gate(componentName, vector<string>(numOfInputs, ""), "", outputExpr, delay);
+        libraryGates[componentName] = Gate(componentName, vector<string>(numOfInputs, ""), "", outputExpr, delay, static_cast<int>(functions.size()) - 1);
 
 
         //Logs the details of the parsed gate for verification
-        cout << "Parsed gate: " << componentName
+        LOG_DEBUG("Parsed gate: " << componentName
             << " with expression: " << libraryGates[componentName].outputExpr
-            << " and delay: " << delay << endl;
+            << " and delay: " << delay);
     }
+    return ok;
 }
 
-// Converts an infix logic expression into postfix notation for easier evaluation during simulation
-vector<string> GateSimulator::infixToPostfix(const string& expression) const {
-    stack<string> opStack;
-    vector<string> output;
-    unordered_map<string, int> precedence{
-        {"~", 3}, // Unary NOT has the highest precedence
-        {"&", 2}, // AND operator
-        {"|", 1}, // OR operator
-        {"^", 1}  // XOR operator, same precedence as OR
-    };
-
-    for (size_t i = 0; i < expression.size(); ++i) {
-        if (isalnum(expression[i])) {
-            string val;
-            while (i < expression.size() && isalnum(expression[i])) {
-                val += expression[i++];
-            }
-            --i; // Correcting the index since it's incremented in the loop above
-            output.push_back(val); // Adds the operand to the output vector
-        }
-        else if (expression[i] == '(') { // If it's an opening parenthesis, push onto the stack
-            opStack.push("(");
-        }
-        else if (expression[i] == ')') { // If it's a closing parenthesis, pop from stack to output until matching '('
-            while (!opStack.empty() && opStack.top() != "(") {
-                output.push_back(opStack.top());
-                opStack.pop();
-            }
-            if (!opStack.empty()) opStack.pop(); //Removes the matching '(' from the stack
-        }
-        else {
-            string op(1, expression[i]);
-            while (!opStack.empty() && precedence[opStack.top()] >= precedence[op]) { // After processing the entire expression, pop any remaining operators to the output
-                output.push_back(opStack.top());
-                opStack.pop();
-            }
-            opStack.push(op);
-        }
+// Adds what one circuit file line declares: a gate, an instance of a module, or the start or end of a module
+// definition. Reports why it cannot and returns false otherwise. 'hashes' holds the NameIndex hash of each
+// token, so the signals are interned without hashing them again.
+bool GateSimulator::addCircuitLine(const string& filename, int lineNumber, const Token* tokens, const size_t* hashes, size_t count, vector<int>& inputIds) {
+    if (tokens[0].text == "MODULE") {
+        return beginModule(filename, lineNumber, tokens, hashes, count);
     }
-
-    while (!opStack.empty()) { // After processing the entire expression, pop any remaining operators to the output
-        output.push_back(opStack.top());
-        opStack.pop();
+    if (tokens[0].text == "ENDMODULE") {
+        if (definingModule < 0 || count != 1) {
+            reportParseError(filename, lineNumber, tokens[0].column, definingModule < 0 ? "ENDMODULE without a MODULE" : "expected ENDMODULE alone on its line");
+            return false;
+        }
+        netlist.modules[definingModule].complete = true;
+        definingModule = -1;
+        return true;
     }
-
-    return output;
-}
-
-// Parses the circuit file to build the simulation model by creating gate objects and setting up signal connections
-void GateSimulator::parseCir(const string& filename) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Failed to open circuit file: " << filename << endl;
-        return;
+    if (count < 3) {
+        reportParseError(filename, lineNumber, tokens[0].column, "expected \"<gate name> <gate type> <output> <inputs>...\"");
+        return false;
     }
-
-    string line;
-    while (getline(file, line)) {
-        if (line.empty()) continue;
-
-        istringstream ss(line);
-        string name, type, output;
-        vector<string> componentInputs;
-
-        ss >> name >> type >> output; //Parses the gate's name, type, and output signal from the line
-        string input;
-        while (ss >> input) { // Reads all input signals for the gate
-            componentInputs.push_back(input); //Adds each input signal to the componentInputs vector
-        }
-        // Checks if the gate type is defined in the library and constructs the gate object if it is
-        if (libraryGates.find(type) != libraryGates.end()) {
-            const Gate& libraryGate = libraryGates[type]; //Retrieves the gate definition from the library
-            string adaptedExpr = adaptExpression(libraryGate.outputExpr, componentInputs);
-            gates[name] = Gate(type, componentInputs, output, adaptedExpr, libraryGate.delay);
-            // Initializes the states of the gate's inputs and output in the signalStates map, if they don't already exist
-            for (const auto& input : componentInputs) {
-                signalToGates[input].push_back(name);
-            }
-            signalToGates[output].push_back(name);
-
-            for (const auto& input : componentInputs) {
-                signalStates.try_emplace(input, 0);
-            }
-            signalStates.try_emplace(output, 0);
-        }
-        else {
-            cerr << "Gate type not found in library: " << type << endl; //Logs an error if the gate type is not found in the library
+    const Token& name = tokens[0];
+    const Token& type = tokens[1];
+
+    // Checks if the gate type is defined in the library and adds the gate if it is
+    auto libraryIt = libraryGates.find(string(type.text));
+    if (libraryIt == libraryGates.end()) {
+        int module = netlist.moduleIndex.find(type.text, hashes[1], netlist.moduleNames);
+        if (module >= 0) {
+            return addInstanceLine(filename, lineNumber, tokens, hashes, count, module, inputIds);
         }
+        reportParseError(filename, lineNumber, type.column, "gate type not found in library: " + string(type.text));
+        return false;
     }
-    // Debugging output : prints the contents of the signalToGates map after parsing the circuit file
-    cout << "Debugging: Contents of signalToGates map after parsing circuit file:" << endl;
-    for (const auto& entry : signalToGates) {
-        cout << "Signal: " << entry.first << ", Associated Gates: ";
-        for (const auto& gateName : entry.second) {
-            cout << gateName << " ";
-        }
-        cout << endl;
+    const Gate& libraryGate = libraryIt->second;
+    size_t numInputs = count - 3;
+    if (numInputs != libraryGate.inputs.size()) {
+        reportParseError(filename, lineNumber, numInputs > libraryGate.inputs.size() ? tokens[3 + libraryGate.inputs.size()].column : type.column,
+            "gate " + string(name.text) + " of type " + libraryGate.type + " expects " + to_string(libraryGate.inputs.size())
+            + " input(s) but has " + to_string(numInputs));
+        return false;
     }
-}
-
 
+    // Inside a module definition the gate goes into the module's body, over its local signals
+    Netlist& target = definingModule < 0 ? netlist : netlist.modules[definingModule].body;
+    if (target.findGate(name.text, hashes[0]) >= 0) {
+        reportParseError(filename, lineNumber, name.column, "duplicate gate name: " + string(name.text));
+        return false;
+    }
 
-// Displays a summary of all gates parsed from the circuit file, including their names, types, inputs, expressions, and delays
-void GateSimulator::printParsedCircuitGates() {
-    cout << "Parsed Gates from Circuit File:" << endl; // Logs a header to indicate the start of the gates summary
-    for (const auto& [name, gate] : gates) { // Iterates over each gate in the 'gates' map
-        cout << "Gate " << name << " with type " << gate.type << ", output " << gate.output
-            << ", input(s): ";
-        for (const auto& input : gate.inputs) {
-            cout << input << " ";
-        }
-        cout << ", expression: " << gate.outputExpr << ", delay: " << gate.delay << endl;
+    // Interns the gate's signals into ids; new signals start at 0
+    inputIds.clear();
+    for (size_t k = 3; k < count; ++k) {
+        inputIds.push_back(target.addSignal(tokens[k].text, hashes[k]));
     }
+    int outputId = target.addSignal(tokens[2].text, hashes[2]);
+    target.addGate(name.text, hashes[0], netlist.addType(libraryGate.type), libraryGate.function, libraryGate.delay, outputId, inputIds);
+    return true;
 }
 
-// Parses the stimuli file to schedule initial events and update signal states before starting the simulation
-void GateSimulator::parseStim(const string& filename) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Failed to open stimuli file: " << filename << endl;
-        return;
+// Starts the definition of a module from a "MODULE <name> <ports>..." line; the lines up to ENDMODULE make up its body
+bool GateSimulator::beginModule(const string& filename, int lineNumber, const Token* tokens, const size_t* hashes, size_t count) {
+    bool ok = true;
+    if (definingModule >= 0) {
+        reportParseError(filename, lineNumber, tokens[0].column, "module " + netlist.moduleNames[definingModule] + " has no ENDMODULE");
+        netlist.modules[definingModule].complete = true;
+        definingModule = -1;
+        ok = false;
+    }
+    if (count < 3) {
+        reportParseError(filename, lineNumber, tokens[0].column, "expected \"MODULE <name> <ports>...\"");
+        return false;
+    }
+    const Token& name = tokens[1];
+    if (libraryGates.count(string(name.text)) || netlist.moduleIndex.find(name.text, hashes[1], netlist.moduleNames) >= 0) {
+        reportParseError(filename, lineNumber, name.column, "module name already used: " + string(name.text));
+        return false;
     }
 
-    string line;
-    int time, value;
-    string signal;
-
-    while (file >> time >> signal >> value) { //Reads each event (time, signal, value) from the file
-        cout << "Parsed event: Time = " << time << ", Signal = " << signal << ", Value = " << value << endl;
-
-        events.push(Event(time, signal, value));
-
-        // Checks if the signal is used as an input to any gate
-        if (signalToGates.find(signal) != signalToGates.end()) {
-            for (const auto& gateName : signalToGates[signal]) {
-                Gate& gate = gates[gateName];
-                // Update the signal states if the signal is an input to a gate
-                if (gate.inputs.end() != find(gate.inputs.begin(), gate.inputs.end(), signal)) {
-                    signalStates[signal] = value; //Updates the state of the signal to the new value
-                }
-            }
+    definingModule = static_cast<int>(netlist.modules.size());
+    netlist.moduleNames.emplace_back(name.text);
+    netlist.moduleIndex.insert(hashes[1], netlist.moduleNames);
+    netlist.modules.emplace_back();
+    Module& module = netlist.modules.back();
+    for (size_t k = 2; k < count; ++k) {
+        if (module.body.findSignal(tokens[k].text) >= 0) {
+            reportParseError(filename, lineNumber, tokens[k].column, "duplicate port: " + string(tokens[k].text));
+            ok = false;
         }
+        module.body.addSignal(tokens[k].text, hashes[k]);
     }
+    module.numPorts = module.body.numSignals();
+    return ok;
 }
 
-
-
-// Evaluates a logical expression based on current signal states and returns the result
-int GateSimulator::evaluateExpression(const string& expression, const vector<string>& inputs) {
-    auto postfixExpr = infixToPostfix(expression); // Converts the infix expression to postfix for easier evaluation
-    stack<int> evalStack; // Stack used for evaluation
-
-    // Logs the expression being evaluated and the current states of its inputs
-    cout << "Evaluating expression: " << expression << " with inputs: ";
-    for (const auto& input : inputs) {
-        cout << input << "(" << signalStates[input] << ") ";
+// Adds an instance of 'module' from a "<instance name> <module> <signal per port>..." line. At the top level
+// only its port signals are interned and its gates stay in the module's body; inside another module
+// definition it is inlined into that module's body.
+bool GateSimulator::addInstanceLine(const string& filename, int lineNumber, const Token* tokens, const size_t* hashes, size_t count, int module,
+    vector<int>& portIds) {
+    const Token& name = tokens[0];
+    const Module& definition = netlist.modules[module];
+    if (!definition.complete) {
+        reportParseError(filename, lineNumber, tokens[1].column, "module " + string(tokens[1].text) + " is used inside its own definition");
+        return false;
+    }
+    size_t numPorts = count - 2;
+    if (numPorts != static_cast<size_t>(definition.numPorts)) {
+        reportParseError(filename, lineNumber, numPorts > static_cast<size_t>(definition.numPorts) ? tokens[2 + definition.numPorts].column : tokens[1].column,
+            "instance " + string(name.text) + " of module " + string(tokens[1].text) + " expects " + to_string(definition.numPorts)
+            + " port(s) but has " + to_string(numPorts));
+        return false;
     }
-    cout << endl;
-
-    for (const auto& token : postfixExpr) { // Iterates through each token in the postfix expression
-        if (token == "~" || token == "&" || token == "|" || token == "^") { // If the token is an operator
-            int result = 0; // Variable to store the result of the operation
-            if (token == "~") {
-                int op1 = evalStack.top(); evalStack.pop(); // Pops the top value for unary operation
-                result = ~op1 & 1; // Assuming binary for simplicity
-            }
-            else {
-                int op2 = evalStack.top(); evalStack.pop(); // Pops the top two values for binary operation
-                int op1 = evalStack.top(); evalStack.pop();
 
-                if (token == "&") result = op1 & op2;
-                else if (token == "|") result = op1 | op2;
-                else if (token == "^") result = op1 ^ op2;
-            }
-            // Pushes the result back onto the stack
-            evalStack.push(result);
+    portIds.clear();
+    if (definingModule < 0) {
+        if (netlist.instanceIndex.find(name.text, hashes[0], netlist.instanceNames) >= 0) {
+            reportParseError(filename, lineNumber, name.column, "duplicate instance name: " + string(name.text));
+            return false;
         }
-        else {
-            // Pushes the current state of the signal onto the stack for evaluation
-            evalStack.push(signalStates.at(token));
+        for (size_t k = 2; k < count; ++k) {
+            portIds.push_back(netlist.addSignal(tokens[k].text, hashes[k]));
         }
+        netlist.addInstance(name.text, hashes[0], module, portIds);
+        return true;
     }
 
-    return !evalStack.empty() ? evalStack.top() : 0; // Returns the result of the expression evaluation (top of the stack)
-}
-
-// Writes a single simulation event to the output file, logging the time, signal, and value
-void GateSimulator::writeOutput(const string& signal, int value, int time) {
-    ofstream simFile("output.sim", ios_base::app);
-    if (simFile.is_open()) {
-        simFile << time << ", " << signal << ", " << value << endl; // Writes the time, signal name, and value to the file
+    Module& parent = netlist.modules[definingModule];
+    if (find(parent.instanceNames.begin(), parent.instanceNames.end(), name.text) != parent.instanceNames.end()) {
+        reportParseError(filename, lineNumber, name.column, "duplicate instance name: " + string(name.text));
+        return false;
     }
-    else {
-        cerr << "Failed to open .sim file for writing." << endl;
+    parent.instanceNames.emplace_back(name.text);
+    for (size_t k = 2; k < count; ++k) {
+        portIds.push_back(parent.body.addSignal(tokens[k].text, hashes[k]));
     }
+    parent.body.inlineModule(name.text, definition, portIds);
+    return true;
 }
 
-
-// Sorts simulation output by time and removes duplicate entries, then writes the cleaned data back to the file
-void GateSimulator::sortAndClean(const string& outputFile = "output.sim") {
-    // Open the output file for reading
-    ifstream inputFile(outputFile);
-    if (!inputFile.is_open()) {
-        cerr << "Failed to open output file: " << outputFile << endl;
-        return;
+// Parses the circuit file to build the simulation model by creating gate objects and setting up signal connections.
+// The file is mapped and tokenized in place; with --parse-threads the tokenizing is split across threads
+// and the lines are then added in file order, so signal and gate ids do not depend on the thread count.
+bool GateSimulator::parseCir(const string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        cerr << "Failed to open circuit file: " << filename << endl;
+        return false;
     }
 
-    // Read lines from the file into a vector
-    vector<string> lines;
-    string line; // Variable to hold each line read from the file
-    while (getline(inputFile, line)) {
-        lines.push_back(line);
+    bool ok = true; // Every line was usable
+    vector<int> inputIds;
+    if (options.parseThreads > 1) {
+        for (const TokenizedLines& piece : tokenizeInChunks(file.text(), options.parseThreads)) {
+            for (size_t line = 0; line < piece.numLines(); ++line) {
+                uint32_t begin = piece.lineStart[line];
+                ok = addCircuitLine(filename, piece.lineNumbers[line], &piece.tokens[begin], &piece.hashes[begin],
+                    piece.lineStart[line + 1] - begin, inputIds) && ok;
+            }
+        }
     }
-
-    // Close the input file
-    inputFile.close();
-
-    // Sort the lines based on timestamps
-    sort(lines.begin(), lines.end(), [](const string& a, const string& b) {
-        istringstream issA(a), issB(b);
-    int timestampA, timestampB;
-    char comma; // Variable to ignore commas during reading
-    issA >> timestampA >> comma; // Extracts the timestamp from the first string
-    issB >> timestampB >> comma; // Extracts the timestamp from the second string
-    return timestampA < timestampB; // Compares timestamps for sorting
+    else {
+        vector<size_t> hashes;
+        forEachLine(file.text(), [&](int lineNumber, const vector<Token>& tokens) {
+            hashes.clear();
+            for (const Token& token : tokens) hashes.push_back(NameIndex::hash(token.text));
+            ok = addCircuitLine(filename, lineNumber, tokens.data(), hashes.data(), tokens.size(), inputIds) && ok;
         });
-
-    // Removes duplicate lines from the vector
-    auto last = unique(lines.begin(), lines.end());
-    lines.erase(last, lines.end());
-
-    // Open the output file for writing (clearing its contents)
-    ofstream outputFileStream(outputFile, ofstream::out | ofstream::trunc);
-    if (!outputFileStream.is_open()) {
-        cerr << "Failed to open output file for writing: " << outputFile << endl;
-        return;
     }
-
-    // Write the sorted and deduplicated lines back to the output file
-    for (const auto& sortedLine : lines) {
-        outputFileStream << sortedLine << '\n';
+    if (definingModule >= 0) {
+        cerr << filename << ": module " << netlist.moduleNames[definingModule] << " has no ENDMODULE" << endl;
+        netlist.modules[definingModule].complete = true;
+        definingModule = -1;
+        ok = false;
     }
-
-    // Close the output file
-    outputFileStream.close();
-
-    cout << "Output file sorted and repetitions removed: " << outputFile << endl;
+    netlist.buildFanout(); // Builds the fanout arrays once all gates are known
+    signalStates.assign(netlist.numSignals(), 0);
+
+    // Debugging output : prints the fanout of each signal after parsing the circuit file
+    if (!logEnabled(LOG_LEVEL_DEBUG)) return ok;
+    cout << "Debugging: Contents of signal fanout after parsing circuit file:" << endl;
+    for (int signal = 0; signal < netlist.numSignals(); ++signal) {
+        cout << "Signal: " << netlist.signalName(signal) << ", Associated Gates: ";
+        netlist.forEachReader(signal, [&](int gate) { cout << netlist.gateName(gate) << " "; });
+        cout << endl;
+    }
+    return ok;
 }
 
-// Processes a single event from the simulation queue, updates signal states, and triggers any dependent gate evaluations
-void GateSimulator::processEvents(const Event& currentEvent) {
-    cout << "Processing event for signal: " << currentEvent.signal
-        << ", value: " << currentEvent.value
-        << ", at time: " << currentEvent.time << endl; // Logs details of the current event being processed
-
-    // Update the state of the signal.
-    signalStates[currentEvent.signal] = currentEvent.value;
-
-    // Write the event to the output file
-    writeOutput(currentEvent.signal, currentEvent.value, currentEvent.time);
-
-    // Check if any gates are affected by this signal change.
-    if (signalToGates.find(currentEvent.signal) != signalToGates.end()) {
-        for (const auto& gateName : signalToGates[currentEvent.signal]) {
-            Gate& gate = gates[gateName]; // Retrieves the gate object
-            cout << "Checking gate: " << gateName << " for signal: " << currentEvent.signal << endl;
-
-            // Debugging: Print gate expression and inputs
-            cout << "Gate " << gateName << " expression: " << gate.outputExpr << endl;
-            cout << "Gate " << gateName << " inputs: ";
-            for (const auto& input : gate.inputs) {
-                cout << input << "(" << signalStates[input] << ") ";
-            }
-            cout << endl;
-
-            // Debugging: Print signal states before evaluating gate expression
-            cout << "Signal states before evaluation: ";
-            for (const auto& [signal, value] : signalStates) {
-                cout << signal << "(" << value << ") ";
-            }
-            cout << endl;
-
-            // Evaluates the gate's output based on the new signal states
-            int oldOutputValue = signalStates[gate.output];
-            int newOutputValue = evaluateExpression(gate.outputExpr, gate.inputs);
-
-            // Logs the result of the gate evaluation and any output change
-            cout << "Gate " << gateName
-                << " Evaluated. Old Output: " << oldOutputValue
-                << ", New Output: " << newOutputValue << endl;
-
-            if (oldOutputValue != newOutputValue) { // // If the gate's output has changed.
-                // Logs and schedules a new event for the updated gate output.
-                cout << "Output change detected. Scheduling new event for " << gate.output
-                    << " at time " << (currentEvent.time + gate.delay)
-                    << " with value " << newOutputValue << endl;
 
-                signalStates[gate.output] = newOutputValue; //  Updates the gate output signal state
-                events.push(Event(currentEvent.time + gate.delay, gate.output, newOutputValue)); // Schedules the new event
 
-                // Write the new event to the output file
-                writeOutput(gate.output, newOutputValue, currentEvent.time + gate.delay);
-            }
+// Displays a summary of all gates parsed from the circuit file, including their names, types, inputs, expressions, and delays
+void GateSimulator::printParsedCircuitGates() {
+    cout << "Parsed Gates from Circuit File:" << endl; // Logs a header to indicate the start of the gates summary
+    for (int gate = 0; gate < netlist.numGates(); ++gate) { // Iterates over each gate in the netlist
+        Netlist::GateView view = netlist.gate(gate);
+        const string& type = netlist.typeNames[view.type()];
+        vector<string> inputNames;
+        for (uint32_t k = 0; k < view.numInputs(); ++k) {
+            inputNames.push_back(netlist.signalName(view.input(k)));
         }
-    }
-    else {
-        cout << "No gates associated with signal: " << currentEvent.signal << endl;
+        cout << "Gate " << netlist.gateName(gate) << " with type " << type
+            << ", output " << netlist.signalName(view.output()) << ", input(s): ";
+        for (const auto& input : inputNames) {
+            cout << input << " ";
+        }
+        cout << ", expression: " << adaptExpression(libraryGates[type].outputExpr, inputNames)
+            << ", delay: " << view.delay() << endl;
     }
 }
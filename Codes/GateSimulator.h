@@ -3,40 +3,60 @@
 
 #include "Gate.h"
 #include "Event.h"
-#include <stack>
+#include "CompiledExpr.h"
+#include "Netlist.h"
+#include "InputParser.h"
+#include "NetlistOptimizer.h"
+#include "SimulationRun.h"
+#include "SimOptions.h"
+#include "SimStats.h"
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
-#include <queue>
 
 using namespace std;
 
 class GateSimulator {
 private:
     unordered_map<string, Gate> libraryGates; // Map to store gate objects parsed from the library file
-    unordered_map<string, Gate> circuitGates; // Map to store gate objects parsed from the circuit file
-    unordered_map<string, int> signalStates; // Map to store signal states
-    stack<Event> events; // Stack to store simulation events
-    unordered_map<string, vector<string>> signalToGates;
+    vector<CompiledExpr> functions; // Library expressions compiled once by parseLib
+    Netlist netlist; // Integer-indexed circuit built by parseCir
+    vector<uint8_t> signalStates; // Value of each signal once the circuit has settled with every input at zero
+    SimOptions options;
+    unique_ptr<SimulationRun> simulation; // Per-run state of the stimuli file given to the constructor
+    SimStats stats; // Counters printed at the end of the simulation
+    OptimizeStats optimized; // What optimize changed, if it was called
+    uint64_t libraryHash = 0, circuitHash = 0; // Of the source files, when the cache or the run history needs them
+    int definingModule = -1; // Module whose definition parseCir is reading, or -1 at the top level
 
 
 public:
-    GateSimulator(const string& libraryFile, const string& circuitFile, const string& stimuliFile);
-    void startSimulation();
+    GateSimulator(const string& libraryFile, const string& circuitFile, const string& stimuliFile, const SimOptions& options = SimOptions());
+    GateSimulator(const string& libraryFile, const string& circuitFile, const SimOptions& options = SimOptions()); // Loads the circuit only
+    const Netlist& getNetlist() const { return netlist; }
+    const vector<CompiledExpr>& getFunctions() const { return functions; }
+    const vector<uint8_t>& getSettledStates() const { return signalStates; }
+    int getMaxDelay() const;
+    const SimStats& getStats() const { return stats; }
+    void expandInstances() { netlist.expandInstances(); } // Copies the instances' gates in, for the engines that index gates directly
+    void optimize(const string& stimuliFile, bool zeroDelay); // Simplifies the netlist for what one stimuli file can show
+    const OptimizeStats& getOptimizeStats() const { return optimized; }
+    void reportOptimization(const SimStats& runStats); // Prints what optimize changed, with the events a run saved
+    bool startSimulation();
     void printGateInfo(const Gate& gate);
     void printInitialState();
     void printParsedCircuitGates();
     void initializeGateOutputs();
-    void sortAndClean(const string& outputFile);
 
 
 private:
-    void parseLib(const string& filename);
-    void parseCir(const string& filename);
-    void parseStim(const string& filename);
-    vector<string> infixToPostfix(const string& expression) const;
-    int evaluateExpression(const string& expression, const vector<string>& inputs);
-    void processEvents(const Event& event);
-    void writeOutput(const string& signal, int value, int time); // Declaration of the new function
+    bool parseLib(const string& filename);
+    bool parseCir(const string& filename);
+    bool addCircuitLine(const string& filename, int lineNumber, const Token* tokens, const size_t* hashes, size_t count, vector<int>& inputIds);
+    bool beginModule(const string& filename, int lineNumber, const Token* tokens, const size_t* hashes, size_t count);
+    bool addInstanceLine(const string& filename, int lineNumber, const Token* tokens, const size_t* hashes, size_t count, int module,
+        vector<int>& portIds);
     string adaptExpression(const string& expression, const vector<string>& inputs);
 
 
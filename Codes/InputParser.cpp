@@ -0,0 +1,180 @@
+#include "InputParser.h"
+#include "Netlist.h"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+}
+
+bool MappedFile::open(const string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            madvise(view, info.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            data = static_cast<const char*>(view);
+            size = info.st_size;
+            mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    // Empty files, pipes and platforms without mmap are read into memory instead
+    ifstream file(path, ios_base::binary);
+    if (!file.is_open()) return false;
+    ostringstream contents;
+    contents << file.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+bool LineReader::open(const string& path) {
+    file.close();
+    file.clear();
+    file.open(path, ios_base::binary);
+    begin = end = 0;
+    return file.is_open();
+}
+
+bool LineReader::next(string_view& line) {
+    for (;;) {
+        const void* newline = memchr(chunk.data() + begin, '\n', end - begin);
+        if (newline) {
+            size_t lineEnd = static_cast<const char*>(newline) - chunk.data();
+            line = string_view(chunk.data() + begin, lineEnd - begin);
+            begin = lineEnd + 1;
+            return true;
+        }
+
+        // Moves the partial line to the front and reads more after it, growing the chunk for a very long line
+        memmove(chunk.data(), chunk.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        if (end == chunk.size()) chunk.resize(chunk.size() * 2);
+        size_t got = 0;
+        if (file.is_open()) {
+            file.read(chunk.data() + end, chunk.size() - end);
+            got = static_cast<size_t>(file.gcount());
+            if (!file) file.close(); // Reached the end of the file
+        }
+        end += got;
+        if (got == 0) {
+            if (end == 0) return false;
+            line = string_view(chunk.data(), end); // The last line has no '\n'
+            begin = end;
+            return true;
+        }
+    }
+}
+
+static bool isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+void tokenizeLine(string_view line, vector<Token>& tokens) {
+    tokens.clear();
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isSeparator(line[i])) ++i;
+        size_t start = i;
+        while (i < line.size() && !isSeparator(line[i])) ++i;
+        if (i > start) tokens.push_back({ line.substr(start, i - start), static_cast<uint32_t>(start + 1) });
+    }
+}
+
+bool parseInt(string_view text, int& value) {
+    auto result = from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == errc() && result.ptr == text.data() + text.size();
+}
+
+bool parseStimulusLine(const vector<Token>& tokens, int& time, int& value, string& error, uint32_t& column) {
+    column = tokens[0].column;
+    if (tokens.size() != 3) {
+        error = "expected \"<time> <signal> <value>\"";
+    }
+    else if (!parseInt(tokens[0].text, time)) {
+        error = "time is not an integer: " + string(tokens[0].text);
+    }
+    else if (!parseInt(tokens[2].text, value) || (value != 0 && value != 1)) {
+        column = tokens[2].column;
+        error = "value must be 0 or 1, got " + string(tokens[2].text);
+    }
+    else {
+        return true;
+    }
+    return false;
+}
+
+void reportParseError(const string& path, int line, int column, const string& message) {
+    cerr << path << ':' << line << ':' << column << ": " << message << endl;
+}
+
+vector<TokenizedLines> tokenizeInChunks(string_view text, int chunks) {
+    chunks = max(1, chunks);
+    if (text.size() < (size_t(1) << 20)) chunks = 1; // Not worth the threads
+
+    // Cuts after the first line end at or past each even split point
+    vector<size_t> cuts = { 0 };
+    for (int c = 1; c < chunks; ++c) {
+        size_t at = max(cuts.back(), text.size() / chunks * c);
+        size_t newline = text.find('\n', at);
+        if (newline == string_view::npos) break;
+        cuts.push_back(newline + 1);
+    }
+    cuts.push_back(text.size());
+
+    size_t numChunks = cuts.size() - 1;
+    vector<TokenizedLines> pieces(numChunks);
+    vector<int> lineCounts(numChunks, 0);
+    auto tokenizeChunk = [&](size_t c) {
+        TokenizedLines& piece = pieces[c];
+        forEachLine(text.substr(cuts[c], cuts[c + 1] - cuts[c]), [&](int lineNumber, const vector<Token>& tokens) {
+            for (const Token& token : tokens) {
+                piece.tokens.push_back(token);
+                piece.hashes.push_back(NameIndex::hash(token.text)); // Interning later only has to probe
+            }
+            piece.lineStart.push_back(static_cast<uint32_t>(piece.tokens.size()));
+            piece.lineNumbers.push_back(lineNumber);
+        });
+        lineCounts[c] = static_cast<int>(count(text.begin() + cuts[c], text.begin() + cuts[c + 1], '\n'));
+    };
+
+    vector<thread> threads;
+    for (size_t c = 1; c < numChunks; ++c) {
+        threads.emplace_back(tokenizeChunk, c);
+    }
+    tokenizeChunk(0);
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    // Line numbers were counted from each chunk's start
+    int offset = 0;
+    for (size_t c = 0; c < numChunks; ++c) {
+        for (int& lineNumber : pieces[c].lineNumbers) lineNumber += offset;
+        offset += lineCounts[c];
+    }
+    return pieces;
+}
@@ -0,0 +1,127 @@
+#ifndef INPUTPARSER_H
+#define INPUTPARSER_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Read-only view of a whole input file, memory-mapped where the platform allows, so
+// parsing works on the file's bytes in place instead of copying lines out of a stream
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const string& path);
+    string_view text() const { return string_view(data, size); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    string buffer; // The contents, where the file could not be mapped
+};
+
+// Reads a file one line at a time through a fixed-size buffer, for files too long to keep in
+// memory even as a mapping, such as stimuli files streamed during a simulation
+class LineReader {
+public:
+    explicit LineReader(size_t chunkSize = 1 << 20) : chunk(chunkSize) {}
+
+    bool open(const string& path);
+
+    // Sets 'line' to the next line, without its '\n', valid until the next call; false at the end
+    bool next(string_view& line);
+
+private:
+    ifstream file;
+    vector<char> chunk;
+    size_t begin = 0; // Unread bytes are chunk[begin, end)
+    size_t end = 0;
+};
+
+// A token of an input line and the column it starts at, counting from 1
+struct Token {
+    string_view text;
+    uint32_t column;
+};
+
+// Splits a line into the tokens between spaces, tabs and commas
+void tokenizeLine(string_view line, vector<Token>& tokens);
+
+// Reads a whole token as a decimal integer
+bool parseInt(string_view text, int& value);
+
+// Prints "<file>:<line>:<column>: <message>" to cerr
+void reportParseError(const string& path, int line, int column, const string& message);
+
+// Calls onLine(lineNumber, tokens) for every line of 'text' that has tokens
+template <typename LineHandler>
+void forEachLine(string_view text, LineHandler onLine) {
+    vector<Token> tokens;
+    int lineNumber = 0;
+    for (size_t begin = 0; begin < text.size();) {
+        const void* newline = memchr(text.data() + begin, '\n', text.size() - begin);
+        size_t end = newline ? static_cast<const char*>(newline) - text.data() : text.size();
+        ++lineNumber;
+        tokenizeLine(text.substr(begin, end - begin), tokens);
+        if (!tokens.empty()) onLine(lineNumber, tokens);
+        begin = end + 1;
+    }
+}
+
+// Tokens of a run of lines in compressed-sparse-row form: the tokens of line k are
+// tokens[lineStart[k]] .. tokens[lineStart[k + 1] - 1], each with its NameIndex hash
+struct TokenizedLines {
+    vector<Token> tokens;
+    vector<size_t> hashes;
+    vector<uint32_t> lineStart = { 0 };
+    vector<int> lineNumbers; // Line number in the whole file of each line with tokens
+
+    size_t numLines() const { return lineNumbers.size(); }
+};
+
+// Tokenizes 'text' in up to 'chunks' pieces cut at line ends, each on its own thread.
+// The pieces come back in file order.
+vector<TokenizedLines> tokenizeInChunks(string_view text, int chunks);
+
+// Reads the time and value of a stimuli line of "<time> <signal> <value>" tokens. Returns false,
+// with the problem in 'error' and the column it starts at in 'column', if the line is malformed.
+bool parseStimulusLine(const vector<Token>& tokens, int& time, int& value, string& error, uint32_t& column);
+
+// Reads a stimuli file of "<time> <signal> <value>" lines, calling onEvent(time, signal, value)
+// for each. Malformed lines are reported with their position and skipped. Returns false if the
+// file could not be read or had malformed lines.
+template <typename EventHandler>
+bool forEachStimulus(const string& path, EventHandler onEvent) {
+    MappedFile file;
+    if (!file.open(path)) {
+        cerr << "Failed to open stimuli file: " << path << endl;
+        return false;
+    }
+
+    bool ok = true;
+    string error;
+    forEachLine(file.text(), [&](int lineNumber, const vector<Token>& tokens) {
+        int time = 0, value = 0;
+        uint32_t column = 0;
+        if (!parseStimulusLine(tokens, time, value, error, column)) {
+            reportParseError(path, lineNumber, column, error);
+            ok = false;
+        }
+        else {
+            onEvent(time, tokens[1].text, value);
+        }
+    });
+    return ok;
+}
+
+#endif // INPUTPARSER_H
@@ -0,0 +1,197 @@
+#include "LevelizedSimulator.h"
+#include "InputParser.h"
+#include "Log.h"
+#include "TraceWriter.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+LevelizedSimulator::LevelizedSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, const SimOptions& options)
+    : netlist(netlist), functions(functions), options(options) {}
+
+bool LevelizedSimulator::levelize() {
+    vector<int> gateOrder, gateLevel, loopGates;
+    if (!levelizeNetlist(netlist, gateOrder, gateLevel, loopGates)) {
+        cerr << "Combinational loop through gate(s):";
+        for (int gate : loopGates) {
+            cerr << " " << netlist.gateName(gate);
+        }
+        cerr << endl;
+        return false;
+    }
+
+    // Copies the gates into flat arrays in sweep order
+    orderedFunction.clear();
+    orderedOutput.clear();
+    orderedInputs.clear();
+    orderedInputStart.assign(1, 0);
+    for (int gate : gateOrder) {
+        orderedFunction.push_back(netlist.gateFunction[gate]);
+        orderedOutput.push_back(netlist.gateOutput[gate]);
+        for (uint32_t k = netlist.gateInputStart[gate]; k < netlist.gateInputStart[gate + 1]; ++k) {
+            orderedInputs.push_back(netlist.gateInputs[k]);
+        }
+        orderedInputStart.push_back(static_cast<uint32_t>(orderedInputs.size()));
+    }
+    levels = gateLevel.empty() ? 0 : *max_element(gateLevel.begin(), gateLevel.end()) + 1;
+
+    findPrimaryOutputs(netlist, primaryOutputs);
+    return true;
+}
+
+// Evaluates every gate once in level order, so each gate sees its inputs' final values
+void LevelizedSimulator::sweep() {
+    int numGates = static_cast<int>(orderedOutput.size());
+    for (int i = 0; i < numGates; ++i) {
+        uint32_t begin = orderedInputStart[i];
+        uint32_t packedInputs = 0;
+        for (uint32_t k = begin; k < orderedInputStart[i + 1]; ++k) {
+            packedInputs |= static_cast<uint32_t>(signalStates[orderedInputs[k]]) << (k - begin);
+        }
+        signalStates[orderedOutput[i]] = static_cast<uint8_t>(functions[orderedFunction[i]].evaluate(packedInputs));
+    }
+}
+
+bool LevelizedSimulator::run(const string& stimuliFile) {
+    vector<uint8_t> driven(netlist.numSignals(), 0);
+    for (int output : netlist.gateOutput) driven[output] = 1;
+
+    struct Stimulus { int time; int signal; int value; };
+    vector<Stimulus> stimuli;
+    bool parsed = forEachStimulus(stimuliFile, [&](int time, string_view signal, int value) {
+        int id = netlist.findSignal(signal);
+        if (id < 0 || driven[id]) {
+            cerr << "Ignoring stimulus on " << signal << " at time " << time
+                << ": only primary inputs can be driven in levelized mode" << endl;
+            return;
+        }
+        stimuli.push_back({ time, id, value });
+    });
+    if (!parsed) {
+        return false;
+    }
+    stable_sort(stimuli.begin(), stimuli.end(), [](const Stimulus& a, const Stimulus& b) { return a.time < b.time; });
+
+    signalStates.assign(netlist.numSignals(), 0);
+    sweep(); // Settles the circuit with every input at zero
+
+    TraceWriter trace;
+    trace.configure(options.traceFormat, options.watchList);
+    if (!trace.open(options.outputFile, netlist)) {
+        cerr << "Failed to open .sim file for writing: " << options.outputFile << endl;
+        return false;
+    }
+    trace.writeInitialValues([&](int signal) { return signalStates[signal]; });
+
+    // Applies all stimuli of a time point, sweeps once, then reports every primary output
+    size_t timePoints = 0;
+    for (size_t next = 0; next < stimuli.size();) {
+        int now = stimuli[next].time;
+        for (; next < stimuli.size() && stimuli[next].time == now; ++next) {
+            signalStates[stimuli[next].signal] = static_cast<uint8_t>(stimuli[next].value);
+        }
+        sweep();
+        for (int output : primaryOutputs) {
+            trace.write(now, output, signalStates[output]);
+        }
+        ++timePoints;
+    }
+    if (!trace.close()) {
+        cerr << "Failed to write the trace file: " << options.outputFile << endl;
+        return false;
+    }
+
+    LOG_INFO("Levelized simulation complete: " << orderedOutput.size() << " gates in " << levels
+        << " levels, " << timePoints << " time points.");
+    return true;
+}
+
+void findPrimaryOutputs(const Netlist& netlist, vector<int>& primaryOutputs) {
+    primaryOutputs.clear();
+    vector<uint8_t> driven(netlist.numSignals(), 0);
+    for (int output : netlist.gateOutput) driven[output] = 1;
+    for (int signal = 0; signal < netlist.numSignals(); ++signal) {
+        if (driven[signal] && netlist.fanoutStart[signal] == netlist.fanoutStart[signal + 1]) {
+            primaryOutputs.push_back(signal);
+        }
+    }
+}
+
+// Kahn's algorithm over gates: a gate is ready once every gate driving one of its inputs is
+bool levelizeNetlist(const Netlist& netlist, vector<int>& gateOrder, vector<int>& gateLevel, vector<int>& loopGates) {
+    int numGates = netlist.numGates();
+    vector<int> driverCount(netlist.numSignals(), 0);
+    for (int output : netlist.gateOutput) ++driverCount[output];
+
+    // A gate waits for one predecessor per input pin driven by a gate
+    vector<int> pending(numGates, 0);
+    for (int gate = 0; gate < numGates; ++gate) {
+        for (uint32_t k = netlist.gateInputStart[gate]; k < netlist.gateInputStart[gate + 1]; ++k) {
+            pending[gate] += driverCount[netlist.gateInputs[k]];
+        }
+    }
+
+    gateOrder.clear();
+    gateLevel.assign(numGates, 0);
+    for (int gate = 0; gate < numGates; ++gate) {
+        if (pending[gate] == 0) gateOrder.push_back(gate);
+    }
+
+    // gateOrder doubles as the work queue; pins reading the same signal each count once
+    for (size_t head = 0; head < gateOrder.size(); ++head) {
+        int gate = gateOrder[head];
+        int output = netlist.gateOutput[gate];
+        for (uint32_t k = netlist.fanoutStart[output]; k < netlist.fanoutStart[output + 1]; ++k) {
+            int reader = netlist.fanoutGates[k];
+            for (uint32_t p = netlist.gateInputStart[reader]; p < netlist.gateInputStart[reader + 1]; ++p) {
+                if (netlist.gateInputs[p] != output) continue;
+                gateLevel[reader] = max(gateLevel[reader], gateLevel[gate] + 1);
+                if (--pending[reader] == 0) gateOrder.push_back(reader);
+            }
+        }
+    }
+
+    // Sorting by level keeps gates of one level together; ties keep file order
+    stable_sort(gateOrder.begin(), gateOrder.end(), [&](int a, int b) { return gateLevel[a] < gateLevel[b]; });
+
+    // Gates never reached are on a loop or behind one; peels off those behind one (whose
+    // output no unreached gate reads) so only the gates whose outputs feed back remain
+    vector<uint32_t> driverStart(netlist.numSignals() + 1, 0);
+    for (int output : netlist.gateOutput) ++driverStart[output + 1];
+    for (int signal = 0; signal < netlist.numSignals(); ++signal) driverStart[signal + 1] += driverStart[signal];
+    vector<int> drivers(numGates);
+    vector<uint32_t> nextDriver(driverStart.begin(), driverStart.end() - 1);
+    for (int gate = 0; gate < numGates; ++gate) drivers[nextDriver[netlist.gateOutput[gate]]++] = gate;
+
+    vector<int> liveReaders(numGates, 0);
+    vector<int> peel;
+    for (int gate = 0; gate < numGates; ++gate) {
+        if (pending[gate] == 0) continue;
+        int output = netlist.gateOutput[gate];
+        for (uint32_t k = netlist.fanoutStart[output]; k < netlist.fanoutStart[output + 1]; ++k) {
+            if (pending[netlist.fanoutGates[k]] > 0) ++liveReaders[gate];
+        }
+        if (liveReaders[gate] == 0) peel.push_back(gate);
+    }
+    while (!peel.empty()) {
+        int gate = peel.back();
+        peel.pop_back();
+        pending[gate] = 0;
+        for (uint32_t k = netlist.gateInputStart[gate]; k < netlist.gateInputStart[gate + 1]; ++k) {
+            int signal = netlist.gateInputs[k];
+            if (find(netlist.gateInputs.begin() + netlist.gateInputStart[gate], netlist.gateInputs.begin() + k, signal)
+                != netlist.gateInputs.begin() + k) continue; // This reader was already counted off for the signal
+            for (uint32_t d = driverStart[signal]; d < driverStart[signal + 1]; ++d) {
+                int driver = drivers[d];
+                if (pending[driver] > 0 && --liveReaders[driver] == 0) peel.push_back(driver);
+            }
+        }
+    }
+
+    loopGates.clear();
+    for (int gate = 0; gate < numGates; ++gate) {
+        if (pending[gate] > 0) loopGates.push_back(gate);
+    }
+    return static_cast<int>(gateOrder.size()) == numGates;
+}
@@ -0,0 +1,54 @@
+#ifndef LEVELIZEDSIMULATOR_H
+#define LEVELIZEDSIMULATOR_H
+
+#include "CompiledExpr.h"
+#include "Netlist.h"
+#include "SimOptions.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Zero-delay functional simulation. The gates are sorted topologically once, so every
+// stimulus time point is one linear sweep over flat arrays in that order with no event
+// queue; gate delays are ignored. Writes the primary outputs after each time point.
+class LevelizedSimulator {
+public:
+    LevelizedSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, const SimOptions& options);
+
+    // Orders the gates by level. Returns false, naming the gates involved, if the
+    // circuit contains a combinational loop.
+    bool levelize();
+
+    bool run(const string& stimuliFile);
+
+    int numLevels() const { return levels; }
+
+private:
+    const Netlist& netlist;
+    const vector<CompiledExpr>& functions;
+    SimOptions options;
+    int levels = 0;
+
+    // The gates in level order, laid out so the sweep reads them front to back
+    vector<int> orderedFunction;
+    vector<int> orderedOutput;
+    vector<uint32_t> orderedInputStart;
+    vector<int> orderedInputs;
+    vector<int> primaryOutputs; // Signals driven by a gate and read by none, in id order
+
+    vector<uint8_t> signalStates;
+
+    void sweep();
+};
+
+// Sorts the gates topologically: 'gateOrder' lists them by level, where a gate's level is one
+// more than the deepest gate driving it. Returns false if some gates are on a combinational
+// loop; 'loopGates' then lists the gates whose outputs feed back.
+bool levelizeNetlist(const Netlist& netlist, vector<int>& gateOrder, vector<int>& gateLevel, vector<int>& loopGates);
+
+// Lists the signals driven by a gate and read by none, in id order
+void findPrimaryOutputs(const Netlist& netlist, vector<int>& primaryOutputs);
+
+#endif // LEVELIZEDSIMULATOR_H
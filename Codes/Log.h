@@ -0,0 +1,43 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <iostream>
+
+using namespace std;
+
+// Log levels, from always shown to most detailed
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4 // Per event and per gate evaluation
+
+// Most detailed level compiled in; anything above it is removed by the compiler.
+// Build with -DSIM_LOG_LEVEL=4 to get the per-event trace points back.
+#ifndef SIM_LOG_LEVEL
+#define SIM_LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Most detailed level shown at run time, set from the command line
+inline int logVerbosity = LOG_LEVEL_INFO;
+
+inline bool logEnabled(int level) {
+    return level <= SIM_LOG_LEVEL && level <= logVerbosity;
+}
+
+// 'message' is a stream expression such as "Parsed " << count << " gates"; it is not
+// evaluated at all when the level is disabled. Errors and warnings go to cerr.
+#define SIM_LOG(level, message) \
+    do { \
+        if ((level) <= SIM_LOG_LEVEL && (level) <= logVerbosity) { \
+            ((level) <= LOG_LEVEL_WARN ? cerr : cout) << message << '\n'; \
+        } \
+    } while (0)
+
+#define LOG_ERROR(message) SIM_LOG(LOG_LEVEL_ERROR, message)
+#define LOG_WARN(message) SIM_LOG(LOG_LEVEL_WARN, message)
+#define LOG_INFO(message) SIM_LOG(LOG_LEVEL_INFO, message)
+#define LOG_DEBUG(message) SIM_LOG(LOG_LEVEL_DEBUG, message)
+#define LOG_TRACE(message) SIM_LOG(LOG_LEVEL_TRACE, message)
+
+#endif // LOG_H
@@ -0,0 +1,222 @@
+#include "Netlist.h"
+
+using namespace std;
+
+int Netlist::signalInstance(int id, int& top) const {
+    top = id;
+    // The last instance whose signals start at or before 'id'
+    auto after = upper_bound(instances.begin(), instances.end(), id, [](int id, const Instance& instance) { return id < instance.firstSignal; });
+    if (after == instances.begin()) return -1;
+    const Instance& instance = *(after - 1);
+    int internal = modules[instance.module].numInternal();
+    if (id < instance.firstSignal + internal) return static_cast<int>(after - instances.begin()) - 1;
+    top = id - instance.signalsBefore - internal;
+    return -1;
+}
+
+int Netlist::gateInstance(int id, int& top) const {
+    top = id;
+    auto after = upper_bound(instances.begin(), instances.end(), id, [](int id, const Instance& instance) { return id < instance.firstGate; });
+    if (after == instances.begin()) return -1;
+    const Instance& instance = *(after - 1);
+    if (id < instance.firstGate + instance.numGates) return static_cast<int>(after - instances.begin()) - 1;
+    top = id - instance.gatesBefore - instance.numGates;
+    return -1;
+}
+
+// The id of signalNames[top]: the top-level signals before an instance are the ids before its
+// first signal that no earlier instance holds
+int Netlist::topSignalId(int top) const {
+    auto after = upper_bound(instances.begin(), instances.end(), top,
+        [](int top, const Instance& instance) { return top < instance.firstSignal - instance.signalsBefore; });
+    if (after == instances.begin()) return top;
+    const Instance& instance = *(after - 1);
+    return top + instance.signalsBefore + modules[instance.module].numInternal();
+}
+
+int Netlist::topGateId(int top) const {
+    auto after = upper_bound(instances.begin(), instances.end(), top,
+        [](int top, const Instance& instance) { return top < instance.firstGate - instance.gatesBefore; });
+    if (after == instances.begin()) return top;
+    const Instance& instance = *(after - 1);
+    return top + instance.gatesBefore + instance.numGates;
+}
+
+int Netlist::findSignal(string_view name) const {
+    int top = signalIndex.find(name, NameIndex::hash(name), signalNames);
+    if (top >= 0) return instances.empty() ? top : topSignalId(top);
+
+    size_t slash = name.find('/');
+    if (instances.empty() || slash == string_view::npos) return -1;
+    string_view prefix = name.substr(0, slash);
+    int instance = instanceIndex.find(prefix, NameIndex::hash(prefix), instanceNames);
+    if (instance < 0) return -1;
+    const Module& module = modules[instances[instance].module];
+    string_view local = name.substr(slash + 1);
+    int id = module.body.signalIndex.find(local, NameIndex::hash(local), module.body.signalNames);
+    return id < module.numPorts ? -1 : instances[instance].firstSignal + id - module.numPorts;
+}
+
+string Netlist::signalName(int id) const {
+    int top = id;
+    int instance = instances.empty() ? -1 : signalInstance(id, top);
+    if (instance < 0) return signalNames[top];
+    const Module& module = modules[instances[instance].module];
+    return instanceNames[instance] + '/' + module.body.signalNames[module.numPorts + id - instances[instance].firstSignal];
+}
+
+string Netlist::gateName(int id) const {
+    int top = id;
+    int instance = instances.empty() ? -1 : gateInstance(id, top);
+    if (instance < 0) return gateNames[top];
+    const Module& module = modules[instances[instance].module];
+    return instanceNames[instance] + '/' + module.body.gateNames[id - instances[instance].firstGate];
+}
+
+void Netlist::addInstance(string_view name, size_t nameHash, int module, const vector<int>& ports) {
+    const Module& definition = modules[module];
+    Instance instance{ module, numSignals(), numGates(), definition.body.numGates(), 0, 0, static_cast<int>(instancePorts.size()) };
+    if (!instances.empty()) {
+        const Instance& last = instances.back();
+        instance.signalsBefore = last.signalsBefore + modules[last.module].numInternal();
+        instance.gatesBefore = last.gatesBefore + last.numGates;
+    }
+    instanceNames.emplace_back(name);
+    instanceIndex.insert(nameHash, instanceNames);
+    instances.push_back(instance);
+    instancePorts.insert(instancePorts.end(), ports.begin(), ports.end());
+    instanceSignals += definition.numInternal();
+    instanceGates += instance.numGates;
+}
+
+Netlist::GateView Netlist::sharedGate(int id) const {
+    int top = id;
+    int instance = gateInstance(id, top);
+    if (instance < 0) return { this, top, nullptr, nullptr, 0 };
+    const Instance& owner = instances[instance];
+    const Module& module = modules[owner.module];
+    return { &module.body, id - owner.firstGate, &owner, instancePorts.data() + owner.firstPort, module.numPorts };
+}
+
+const Netlist* Netlist::sharedReaders(int signal, int& row, int& firstGate) const {
+    int instance = signalInstance(signal, row);
+    if (instance < 0) return this; // Row 'row' of this netlist's fanout
+    const Instance& owner = instances[instance];
+    const Module& module = modules[owner.module];
+    row = module.numPorts + signal - owner.firstSignal; // An internal signal is read only by the instance's own gates
+    firstGate = owner.firstGate;
+    return &module.body;
+}
+
+// Lists, for each signal outside the instances, the gates outside them that read it and the gates of
+// every instance whose ports it connects to, taken from the body's fanout of the port. Only the ports
+// are visited, not the instances' gates.
+void Netlist::buildSharedFanout() {
+    for (Module& module : modules) {
+        module.body.buildFanout();
+    }
+
+    // Row of each signal outside the instances; -1 inside one
+    vector<int> row(numSignals(), -1);
+    int signal = 0, nextRow = 0;
+    for (const Instance& instance : instances) {
+        for (; signal < instance.firstSignal; ++signal) row[signal] = nextRow++;
+        signal += modules[instance.module].numInternal();
+    }
+    for (; signal < numSignals(); ++signal) row[signal] = nextRow++;
+
+    // Visits every signal read and the gate reading it in gate id order, once to count and once to fill the rows
+    auto forEachRead = [&](auto visit) {
+        int gate = 0, top = 0;
+        auto topGates = [&](int end) {
+            for (; gate < end; ++gate, ++top) {
+                for (uint32_t k = gateInputStart[top]; k < gateInputStart[top + 1]; ++k) visit(gateInputs[k], gate);
+            }
+        };
+        for (const Instance& instance : instances) {
+            topGates(instance.firstGate);
+            const Module& module = modules[instance.module];
+            for (int port = 0; port < module.numPorts; ++port) {
+                for (uint32_t k = module.body.fanoutStart[port]; k < module.body.fanoutStart[port + 1]; ++k) {
+                    visit(instancePorts[instance.firstPort + port], instance.firstGate + module.body.fanoutGates[k]);
+                }
+            }
+            gate += instance.numGates;
+        }
+        topGates(numGates());
+    };
+    size_t numRows = signalNames.size();
+    fanoutStart.assign(numRows + 1, 0);
+    forEachRead([&](int signal, int) {
+        if (row[signal] >= 0) ++fanoutStart[row[signal] + 1];
+    });
+    for (size_t r = 0; r < numRows; ++r) {
+        fanoutStart[r + 1] += fanoutStart[r];
+    }
+    fanoutGates.assign(fanoutStart[numRows], 0);
+    vector<uint32_t> next(fanoutStart.begin(), fanoutStart.end() - 1);
+    forEachRead([&](int signal, int gate) {
+        if (row[signal] >= 0) fanoutGates[next[row[signal]]++] = gate;
+    });
+
+    // A signal on several ports of one instance lists the instance's gates out of order, and a gate
+    // reading a signal on several pins or ports is listed once
+    uint32_t write = 0;
+    for (size_t r = 0; r < numRows; ++r) {
+        auto begin = fanoutGates.begin() + fanoutStart[r], end = fanoutGates.begin() + fanoutStart[r + 1];
+        if (!is_sorted(begin, end)) sort(begin, end);
+        fanoutStart[r] = write;
+        for (auto it = begin; it != end; ++it) {
+            if (write == fanoutStart[r] || fanoutGates[write - 1] != *it) fanoutGates[write++] = *it;
+        }
+    }
+    fanoutStart[numRows] = write;
+    fanoutGates.resize(write);
+}
+
+void Netlist::expandInstances() {
+    if (!sharesGates()) return;
+    vector<int> type, function, delay, output, inputs;
+    vector<uint32_t> inputStart = { 0 };
+    type.reserve(numGates());
+    function.reserve(numGates());
+    delay.reserve(numGates());
+    output.reserve(numGates());
+    forEachGate([&](int, const GateView& view) {
+        type.push_back(view.type());
+        function.push_back(view.function());
+        delay.push_back(view.delay());
+        output.push_back(view.output());
+        for (uint32_t k = 0; k < view.numInputs(); ++k) {
+            inputs.push_back(view.input(k));
+        }
+        inputStart.push_back(static_cast<uint32_t>(inputs.size()));
+    });
+    gateType = move(type);
+    gateFunction = move(function);
+    gateDelay = move(delay);
+    gateOutput = move(output);
+    gateInputStart = move(inputStart);
+    gateInputs = move(inputs);
+    instancesExpanded = true;
+    buildFanout();
+}
+
+void Netlist::inlineModule(string_view name, const Module& module, const vector<int>& ports) {
+    const Netlist& body = module.body;
+    string prefix = string(name) + '/';
+    vector<int> ids(ports);
+    for (int local = module.numPorts; local < body.numSignals(); ++local) {
+        ids.push_back(addSignal(prefix + body.signalNames[local]));
+    }
+    vector<int> inputs;
+    for (int gate = 0; gate < body.numGates(); ++gate) {
+        inputs.clear();
+        for (uint32_t k = body.gateInputStart[gate]; k < body.gateInputStart[gate + 1]; ++k) {
+            inputs.push_back(ids[body.gateInputs[k]]);
+        }
+        string gateName = prefix + body.gateNames[gate];
+        addGate(gateName, NameIndex::hash(gateName), body.gateType[gate], body.gateFunction[gate], body.gateDelay[gate],
+            ids[body.gateOutput[gate]], inputs);
+    }
+}
@@ -0,0 +1,322 @@
+#ifndef NETLIST_H
+#define NETLIST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Open-addressing hash table from names to dense ids 0, 1, 2, ... It stores only the ids and
+// compares against the caller's name list, so lookups take a string_view and never allocate.
+class NameIndex {
+public:
+    static size_t hash(string_view name) { return std::hash<string_view>()(name); }
+
+    // Returns the id of 'name', or -1; 'h' must be hash(name)
+    int find(string_view name, size_t h, const vector<string>& names) const {
+        if (slots.empty()) return -1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            int id = slots[i];
+            if (id < 0 || names[id] == name) return id;
+        }
+    }
+
+    // Adds the next id, names[count], whose hash is 'h'
+    void insert(size_t h, const vector<string>& names) {
+        if ((count + 1) * 2 > slots.size()) grow(names); // Keeps probe runs short
+        place(static_cast<int>(count++), h);
+    }
+
+    // The raw table, so a netlist cache can save it and load it back without rehashing every name
+    const vector<int>& getSlots() const { return slots; }
+    size_t size() const { return count; }
+
+    // Restores a saved table; returns false if it cannot belong to 'numNames' names
+    bool restore(vector<int> savedSlots, size_t numNames) {
+        if (savedSlots.size() & (savedSlots.size() - 1)) return false; // Not a power of two
+        size_t filled = 0;
+        for (int id : savedSlots) {
+            if (id >= static_cast<int>(numNames)) return false;
+            filled += id >= 0;
+        }
+        if (filled != numNames || (numNames > 0 && numNames >= savedSlots.size())) return false; // Lookups need an empty slot
+        slots = move(savedSlots);
+        mask = slots.empty() ? 0 : slots.size() - 1;
+        count = numNames;
+        return true;
+    }
+
+private:
+    vector<int> slots; // -1 marks an empty slot
+    size_t mask = 0;
+    size_t count = 0;
+
+    void place(int id, size_t h) {
+        size_t i = h & mask;
+        while (slots[i] >= 0) i = (i + 1) & mask;
+        slots[i] = id;
+    }
+
+    void grow(const vector<string>& names) {
+        size_t size = max<size_t>(64, slots.size() * 2);
+        slots.assign(size, -1);
+        mask = size - 1;
+        for (size_t id = 0; id < count; ++id) {
+            place(static_cast<int>(id), hash(names[id]));
+        }
+    }
+};
+
+struct Module;
+
+// One instance of a module in the circuit. Its internal signals, and its gates, have
+// consecutive ids, so their values lie next to each other in every per-signal array.
+struct Instance {
+    int module;
+    int firstSignal; // Id of its first internal signal
+    int firstGate;
+    int numGates; // 0 once the optimizer has renamed the gates it kept one by one
+    int signalsBefore; // Internal signals of the instances before it
+    int gatesBefore; // Gates of the instances before it
+    int firstPort; // Index in Netlist::instancePorts of the signal its first port connects to
+};
+
+// Flat, integer-indexed circuit built by parseCir. Signals and gates are interned into
+// dense ids; names are kept only for reading input files and writing output.
+// Per-gate input lists and per-signal fanout lists are stored in compressed-sparse-row form:
+// the entries of item k live in [start[k], start[k + 1]) of the matching flat array.
+//
+// The gates of module instances are not copied: each module's body is stored once, and gate(id)
+// finds an instance's gate in it through the Instance, mapping the body's local signal ids to the
+// instance's. The arrays below then hold only the gates outside instances, indexed as in gateNames,
+// and the fanout only the signals outside instances, indexed as in signalNames; an instance costs
+// its Instance and its port list, plus one value per signal and gate in each run's state arrays.
+// Engines that index the arrays by gate id call expandInstances first, which copies the instances'
+// gates in.
+struct Netlist {
+    vector<string> signalNames; // Names of the signals outside instances, in id order
+    NameIndex signalIndex; // Name -> index in signalNames
+
+    vector<string> gateNames; // Names of the gates outside instances, in id order
+    NameIndex gateIndex; // Name -> index in gateNames
+    vector<string> typeNames; // Type id -> library gate name
+    vector<int> gateType; // Gate id -> type id
+    vector<int> gateFunction; // Gate id -> index of its compiled expression
+    vector<int> gateDelay;
+    vector<int> gateOutput; // Gate id -> output signal id
+
+    vector<uint32_t> gateInputStart = { 0 }; // Size numGates() + 1
+    vector<int> gateInputs; // Input signal ids of all gates, in pin order
+
+    vector<uint32_t> fanoutStart; // Size numSignals() + 1, filled by buildFanout; signalNames.size() + 1 while sharesGates()
+    vector<int> fanoutGates; // Gate ids reading each signal
+
+    vector<string> moduleNames; // Module id -> name
+    NameIndex moduleIndex;
+    vector<Module> modules;
+    vector<string> instanceNames; // Instance id -> name
+    NameIndex instanceIndex;
+    vector<Instance> instances; // In id order of their signals and gates
+    vector<int> instancePorts; // Signal ids the ports of every instance connect to, instance by instance
+    int instanceSignals = 0; // Internal signals of all instances
+    int instanceGates = 0; // Gates of all instances
+    bool instancesExpanded = false; // Set by expandInstances
+
+    // Where one gate's data is kept: in this netlist, or in the body of the module it is an instance
+    // of, whose local signal ids it turns into the instance's
+    struct GateView {
+        const Netlist* arrays;
+        int index; // In 'arrays'
+        const Instance* instance; // Null outside an instance
+        const int* ports; // The instance's port signals
+        int numPorts;
+
+        int signal(int local) const {
+            if (!instance) return local;
+            return local < numPorts ? ports[local] : instance->firstSignal + local - numPorts;
+        }
+        int type() const { return arrays->gateType[index]; }
+        int function() const { return arrays->gateFunction[index]; }
+        int delay() const { return arrays->gateDelay[index]; }
+        int output() const { return signal(arrays->gateOutput[index]); }
+        uint32_t numInputs() const { return arrays->gateInputStart[index + 1] - arrays->gateInputStart[index]; }
+        int input(uint32_t k) const { return signal(arrays->gateInputs[arrays->gateInputStart[index] + k]); }
+    };
+
+    // True while the instances' gates are reached through their module bodies
+    bool sharesGates() const { return !instances.empty() && !instancesExpanded; }
+
+    int numSignals() const { return static_cast<int>(signalNames.size()) + instanceSignals; }
+    int numGates() const { return static_cast<int>(gateOutput.size()) + (instancesExpanded ? 0 : instanceGates); }
+
+    GateView gate(int id) const {
+        if (!sharesGates()) return { this, id, nullptr, nullptr, 0 };
+        return sharedGate(id);
+    }
+
+    // Calls 'visit' with the id and the view of every gate in id order, walking the instances instead
+    // of searching for each gate's
+    template <typename Visit>
+    void forEachGate(Visit visit) const;
+
+    // Calls 'visit' with each gate reading 'signal', once each, in increasing id order
+    template <typename Visit>
+    void forEachReader(int signal, Visit visit) const {
+        const Netlist* rows = this;
+        int row = signal, firstGate = 0;
+        if (sharesGates()) rows = sharedReaders(signal, row, firstGate);
+        for (uint32_t k = rows->fanoutStart[row]; k < rows->fanoutStart[row + 1]; ++k) {
+            visit(firstGate + rows->fanoutGates[k]);
+        }
+    }
+
+    // Returns the id of 'name', interning it if it has not been seen yet; 'h' is NameIndex::hash(name)
+    int addSignal(string_view name, size_t h) {
+        int top = signalIndex.find(name, h, signalNames);
+        if (top >= 0) return instances.empty() ? top : topSignalId(top);
+
+        int id = numSignals();
+        signalNames.emplace_back(name);
+        signalIndex.insert(h, signalNames);
+        if (!fanoutStart.empty()) fanoutStart.push_back(fanoutStart.back()); // Signals added late have no fanout
+        return id;
+    }
+
+    int addSignal(string_view name) { return addSignal(name, NameIndex::hash(name)); }
+
+    // Returns the id of 'name', or -1 if the circuit does not use it. A signal inside an instance
+    // is found as "<instance>/<name>"; a port is named by the signal it connects to.
+    int findSignal(string_view name) const;
+
+    // Returns the id of the gate called 'name' outside any instance, or -1
+    int findGate(string_view name, size_t h) const {
+        int top = gateIndex.find(name, h, gateNames);
+        return top < 0 || instances.empty() ? top : topGateId(top);
+    }
+
+    string signalName(int id) const;
+    string gateName(int id) const;
+
+    // The name of a signal outside every instance, or null for one inside an instance
+    const string* topSignalName(int id) const {
+        if (instances.empty()) return &signalNames[id];
+        int top = 0;
+        return signalInstance(id, top) < 0 ? &signalNames[top] : nullptr;
+    }
+
+    int addType(const string& name) {
+        for (size_t i = 0; i < typeNames.size(); ++i) {
+            if (typeNames[i] == name) return static_cast<int>(i);
+        }
+        typeNames.push_back(name);
+        return static_cast<int>(typeNames.size()) - 1;
+    }
+
+    void addGate(string_view name, size_t nameHash, int type, int function, int delay, int output, const vector<int>& inputs) {
+        gateNames.emplace_back(name);
+        gateIndex.insert(nameHash, gateNames);
+        addUnnamedGate(type, function, delay, output, inputs);
+    }
+
+    // Adds an instance of modules[module] whose ports connect to the signals 'ports'. Its gates stay in the module's body.
+    void addInstance(string_view name, size_t nameHash, int module, const vector<int>& ports);
+
+    // Copies the gates of every instance into the arrays, in id order, and rebuilds the fanout, for
+    // the engines and the optimizer that index the arrays by gate id
+    void expandInstances();
+
+    // Copies the signals and gates of an instance into this netlist under named ids, prefixing
+    // their names with "<name>/". This is how a module body holds the instances inside it.
+    void inlineModule(string_view name, const Module& module, const vector<int>& ports);
+
+    // Instance holding signal 'id', or -1 with 'top' set to the signal's index in signalNames
+    int signalInstance(int id, int& top) const;
+    int gateInstance(int id, int& top) const;
+
+    // Builds the fanout arrays from the gate input lists with a counting pass
+    void buildFanout() {
+        if (sharesGates()) {
+            buildSharedFanout();
+            return;
+        }
+        fanoutStart.assign(numSignals() + 1, 0);
+        for (int signal : gateInputs) {
+            ++fanoutStart[signal + 1];
+        }
+        for (int s = 0; s < numSignals(); ++s) {
+            fanoutStart[s + 1] += fanoutStart[s];
+        }
+
+        fanoutGates.assign(gateInputs.size(), 0);
+        vector<uint32_t> next(fanoutStart.begin(), fanoutStart.end() - 1);
+        for (int g = 0; g < numGates(); ++g) {
+            for (uint32_t k = gateInputStart[g]; k < gateInputStart[g + 1]; ++k) {
+                int signal = gateInputs[k];
+                // A gate reading the same signal on several pins is listed once
+                if (next[signal] > fanoutStart[signal] && fanoutGates[next[signal] - 1] == g) continue;
+                fanoutGates[next[signal]++] = g;
+            }
+        }
+
+        // Compacts away the slots left by duplicate pins
+        uint32_t write = 0;
+        for (int s = 0; s < numSignals(); ++s) {
+            uint32_t begin = fanoutStart[s];
+            fanoutStart[s] = write;
+            for (uint32_t k = begin; k < next[s]; ++k) {
+                fanoutGates[write++] = fanoutGates[k];
+            }
+        }
+        fanoutStart[numSignals()] = write;
+        fanoutGates.resize(write);
+    }
+
+private:
+    void addUnnamedGate(int type, int function, int delay, int output, const vector<int>& inputs) {
+        gateType.push_back(type);
+        gateFunction.push_back(function);
+        gateDelay.push_back(delay);
+        gateOutput.push_back(output);
+        gateInputs.insert(gateInputs.end(), inputs.begin(), inputs.end());
+        gateInputStart.push_back(static_cast<uint32_t>(gateInputs.size()));
+    }
+
+    int topSignalId(int top) const;
+    int topGateId(int top) const;
+    GateView sharedGate(int id) const;
+    const Netlist* sharedReaders(int signal, int& row, int& firstGate) const; // Fanout rows holding 'signal', and the id of their gate 0
+    void buildSharedFanout();
+};
+
+// A module defined in the circuit file, parsed once however many times it is instanced. Its body
+// is a netlist over local signal ids: the ports in the order of the MODULE line, then the signals
+// only its gates use. The instances inside it are inlined into the body when it is defined.
+struct Module {
+    int numPorts = 0;
+    Netlist body;
+    vector<string> instanceNames; // Of the instances inlined into the body
+    bool complete = false; // ENDMODULE was read; it cannot be instanced before
+
+    int numInternal() const { return body.numSignals() - numPorts; }
+};
+
+template <typename Visit>
+void Netlist::forEachGate(Visit visit) const {
+    int id = 0, top = 0;
+    if (sharesGates()) {
+        for (const Instance& instance : instances) {
+            for (; id < instance.firstGate; ++id) visit(id, GateView{ this, top++, nullptr, nullptr, 0 });
+            const Module& module = modules[instance.module];
+            for (int local = 0; local < instance.numGates; ++local) {
+                visit(id++, GateView{ &module.body, local, &instance, instancePorts.data() + instance.firstPort, module.numPorts });
+            }
+        }
+    }
+    for (; id < numGates(); ++id) visit(id, GateView{ this, top++, nullptr, nullptr, 0 });
+}
+
+#endif // NETLIST_H
@@ -0,0 +1,298 @@
+#include "NetlistCache.h"
+#include "BinaryFile.h"
+#include "InputParser.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Bump whenever the layout below or the meaning of any saved field changes
+static const uint32_t CACHE_VERSION = 4;
+static const uint64_t CACHE_MAGIC = 0x484354454E53434Cull; // "LCSNETCH" in memory order
+static const uint32_t BYTE_ORDER_MARK = 0x01020304; // Reads back differently on a machine of the other byte order
+
+bool hashFileContents(const string& path, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    string_view text = file.text();
+
+    // Mixes eight bytes per step, so hashing a large circuit costs about as much as reading it
+    ByteHash bytes;
+    bytes.add(text.data(), text.size());
+    hash = bytes.result();
+    return true;
+}
+
+namespace {
+
+// True if every entry of 'ids' is in [0, limit)
+bool allBelow(const vector<int>& ids, int limit) {
+    for (int id : ids) {
+        if (id < 0 || id >= limit) return false;
+    }
+    return true;
+}
+
+bool noneNegative(const vector<int>& values) {
+    return all_of(values.begin(), values.end(), [](int value) { return value >= 0; });
+}
+
+// True if 'starts' is a valid compressed-sparse-row index of 'items' items over 'rows' rows, none longer than 'maxRow'
+bool validStarts(const vector<uint32_t>& starts, size_t rows, size_t items, size_t maxRow = SIZE_MAX) {
+    if (starts.size() != rows + 1 || starts.front() != 0 || starts.back() != items) return false;
+    for (size_t k = 0; k < rows; ++k) {
+        if (starts[k] > starts[k + 1] || starts[k + 1] - starts[k] > maxRow) return false;
+    }
+    return true;
+}
+
+// The names and gates of a netlist. A module body is saved the same way as the whole circuit.
+void writeGates(BinaryWriter& out, const Netlist& netlist) {
+    out.strings(netlist.signalNames);
+    out.array(netlist.signalIndex.getSlots());
+    out.strings(netlist.gateNames);
+    out.array(netlist.gateIndex.getSlots());
+    out.array(netlist.gateType);
+    out.array(netlist.gateFunction);
+    out.array(netlist.gateDelay);
+    out.array(netlist.gateOutput);
+    out.array(netlist.gateInputStart);
+    out.array(netlist.gateInputs);
+}
+
+void readGates(BinaryReader& in, Netlist& netlist, vector<int>& signalSlots, vector<int>& gateSlots) {
+    in.strings(netlist.signalNames);
+    in.array(signalSlots);
+    in.strings(netlist.gateNames);
+    in.array(gateSlots);
+    in.array(netlist.gateType);
+    in.array(netlist.gateFunction);
+    in.array(netlist.gateDelay);
+    in.array(netlist.gateOutput);
+    in.array(netlist.gateInputStart);
+    in.array(netlist.gateInputs);
+}
+
+// Checks every id of what readGates read before anything indexes with it, then restores the name tables
+bool validGates(Netlist& netlist, vector<int> signalSlots, vector<int> gateSlots, int numTypes, int numFunctions) {
+    int numSignals = netlist.numSignals();
+    size_t numGates = netlist.gateOutput.size();
+    return netlist.gateNames.size() == numGates && netlist.gateType.size() == numGates
+        && netlist.gateFunction.size() == numGates && netlist.gateDelay.size() == numGates && noneNegative(netlist.gateDelay)
+        && allBelow(netlist.gateType, numTypes) && allBelow(netlist.gateFunction, numFunctions) && allBelow(netlist.gateOutput, numSignals)
+        && validStarts(netlist.gateInputStart, numGates, netlist.gateInputs.size(), 32) && allBelow(netlist.gateInputs, numSignals)
+        && netlist.signalIndex.restore(move(signalSlots), netlist.signalNames.size())
+        && netlist.gateIndex.restore(move(gateSlots), netlist.gateNames.size());
+}
+
+// True if the instances take consecutive, non-overlapping blocks of ids and of ports, as addInstance
+// numbers them, and each has the gates of its module's body. Sets instanceGates.
+bool validInstances(Netlist& netlist) {
+    if (netlist.instanceNames.size() != netlist.instances.size()) return false;
+    int signalsBefore = 0, gatesBefore = 0, signalEnd = 0, gateEnd = 0;
+    size_t ports = 0;
+    for (const Instance& instance : netlist.instances) {
+        if (instance.module < 0 || instance.module >= static_cast<int>(netlist.modules.size())) return false;
+        const Module& module = netlist.modules[instance.module];
+        int internal = module.numInternal();
+        if (instance.signalsBefore != signalsBefore || instance.gatesBefore != gatesBefore || instance.numGates != module.body.numGates()
+            || instance.firstSignal < signalEnd || instance.firstGate < gateEnd || instance.firstPort != static_cast<int>(ports)) {
+            return false;
+        }
+        signalEnd = instance.firstSignal + internal;
+        gateEnd = instance.firstGate + instance.numGates;
+        signalsBefore += internal;
+        gatesBefore += instance.numGates;
+        ports += module.numPorts;
+    }
+    netlist.instanceGates = gatesBefore;
+    return netlist.instanceSignals == signalsBefore && signalEnd <= netlist.numSignals() && gateEnd <= netlist.numGates()
+        && netlist.instancePorts.size() == ports && allBelow(netlist.instancePorts, netlist.numSignals());
+}
+
+} // namespace
+
+bool saveNetlistCache(const string& path, uint64_t libraryHash, uint64_t circuitHash, const LoadedCircuit& circuit) {
+    if (circuit.netlist.instancesExpanded) return false; // Only the shared form is saved
+    string partialPath = path + ".partial";
+    BinaryWriter out(partialPath);
+    if (!out.good()) return false;
+
+    out.value(CACHE_MAGIC);
+    out.value(CACHE_VERSION);
+    out.value(BYTE_ORDER_MARK);
+    out.value(libraryHash);
+    out.value(circuitHash);
+    streamoff payloadHashAt = out.position();
+    out.value<uint64_t>(0); // Hash of everything below, filled in at the end
+    out.startHash();
+
+    // Library gate types
+    vector<string> typeNames, expressions;
+    vector<int> typeInputs, typeDelays, typeFunctions;
+    for (const auto& [name, gate] : circuit.libraryGates) {
+        typeNames.push_back(name);
+        expressions.push_back(gate.outputExpr);
+        typeInputs.push_back(static_cast<int>(gate.inputs.size()));
+        typeDelays.push_back(gate.delay);
+        typeFunctions.push_back(gate.function);
+    }
+    out.strings(typeNames);
+    out.strings(expressions);
+    out.array(typeInputs);
+    out.array(typeDelays);
+    out.array(typeFunctions);
+
+    // Compiled expressions, their bytecode laid end to end; the truth tables are rebuilt from it
+    vector<int> functionInputs;
+    vector<uint32_t> codeStart = { 0 };
+    vector<ExprInstr> code;
+    for (const CompiledExpr& function : circuit.functions) {
+        functionInputs.push_back(function.numInputs);
+        code.insert(code.end(), function.code.begin(), function.code.end());
+        codeStart.push_back(static_cast<uint32_t>(code.size()));
+    }
+    out.array(functionInputs);
+    out.array(codeStart);
+    out.array(code);
+
+    // The fanout is rebuilt from the gate inputs on loading
+    const Netlist& netlist = circuit.netlist;
+    out.strings(netlist.typeNames);
+    writeGates(out, netlist);
+
+    // Modules, each body once, and the instances of them
+    out.strings(netlist.moduleNames);
+    out.array(netlist.moduleIndex.getSlots());
+    for (const Module& module : netlist.modules) {
+        out.value(module.numPorts);
+        writeGates(out, module.body);
+    }
+    out.strings(netlist.instanceNames);
+    out.array(netlist.instanceIndex.getSlots());
+    out.array(netlist.instances);
+    out.array(netlist.instancePorts);
+    out.value(netlist.instanceSignals);
+    out.array(circuit.settledStates);
+    out.valueAt(payloadHashAt, out.hashed());
+
+    bool ok = out.good();
+    ok = out.close() && ok;
+    if (!ok || rename(partialPath.c_str(), path.c_str()) != 0) {
+        remove(partialPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadNetlistCache(const string& path, uint64_t libraryHash, uint64_t circuitHash, LoadedCircuit circuit) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    BinaryReader in(file.text());
+
+    if (in.value<uint64_t>() != CACHE_MAGIC || in.value<uint32_t>() != CACHE_VERSION || in.value<uint32_t>() != BYTE_ORDER_MARK
+        || in.value<uint64_t>() != libraryHash || in.value<uint64_t>() != circuitHash) {
+        return false;
+    }
+    // A damaged byte anywhere below is caught here, before any of it is decoded
+    uint64_t payloadHash = in.value<uint64_t>();
+    ByteHash payload;
+    payload.add(in.rest().data(), in.rest().size());
+    if (!in.good() || payload.result() != payloadHash) {
+        return false;
+    }
+
+    // Everything is read into locals first, so a damaged cache leaves the circuit untouched
+    vector<string> typeNames, expressions;
+    vector<int> typeInputs, typeDelays, typeFunctions;
+    in.strings(typeNames);
+    in.strings(expressions);
+    in.array(typeInputs);
+    in.array(typeDelays);
+    in.array(typeFunctions);
+
+    vector<int> functionInputs;
+    vector<uint32_t> codeStart;
+    vector<ExprInstr> code;
+    in.array(functionInputs);
+    in.array(codeStart);
+    in.array(code);
+
+    Netlist netlist;
+    vector<int> signalSlots, gateSlots, moduleSlots, instanceSlots;
+    vector<uint8_t> settledStates;
+    in.strings(netlist.typeNames);
+    readGates(in, netlist, signalSlots, gateSlots);
+    in.strings(netlist.moduleNames);
+    in.array(moduleSlots);
+    vector<vector<int>> bodySignalSlots(netlist.moduleNames.size()), bodyGateSlots(netlist.moduleNames.size());
+    netlist.modules.resize(netlist.moduleNames.size());
+    for (size_t m = 0; m < netlist.modules.size() && in.good(); ++m) {
+        netlist.modules[m].numPorts = in.value<int>();
+        netlist.modules[m].complete = true;
+        readGates(in, netlist.modules[m].body, bodySignalSlots[m], bodyGateSlots[m]);
+    }
+    in.strings(netlist.instanceNames);
+    in.array(instanceSlots);
+    in.array(netlist.instances);
+    in.array(netlist.instancePorts);
+    netlist.instanceSignals = in.value<int>();
+    in.array(settledStates);
+    if (!in.good()) return false;
+
+    // Checks every id and count before anything indexes or allocates with it
+    size_t numTypes = typeNames.size();
+    size_t numFunctions = functionInputs.size();
+    if (expressions.size() != numTypes || typeInputs.size() != numTypes || typeDelays.size() != numTypes
+        || typeFunctions.size() != numTypes || !allBelow(typeInputs, 33) || !noneNegative(typeDelays)
+        || !validStarts(codeStart, numFunctions, code.size()) || !allBelow(typeFunctions, static_cast<int>(numFunctions))
+        || !netlist.moduleIndex.restore(move(moduleSlots), netlist.moduleNames.size())) {
+        return false;
+    }
+    int numCircuitTypes = static_cast<int>(netlist.typeNames.size());
+    for (size_t m = 0; m < netlist.modules.size(); ++m) {
+        Module& module = netlist.modules[m];
+        if (module.numPorts < 0 || module.numPorts > module.body.numSignals()
+            || !validGates(module.body, move(bodySignalSlots[m]), move(bodyGateSlots[m]), numCircuitTypes, static_cast<int>(numFunctions))) {
+            return false;
+        }
+    }
+    if (netlist.instanceSignals < 0 || !validInstances(netlist) || !netlist.instanceIndex.restore(move(instanceSlots), netlist.instanceNames.size())) {
+        return false;
+    }
+    int numSignals = netlist.numSignals();
+    if (!validGates(netlist, move(signalSlots), move(gateSlots), numCircuitTypes, static_cast<int>(numFunctions))
+        || settledStates.size() != static_cast<size_t>(numSignals)
+        || any_of(settledStates.begin(), settledStates.end(), [](uint8_t value) { return value > 1; })) {
+        return false;
+    }
+    netlist.buildFanout();
+
+    vector<CompiledExpr> functions(numFunctions);
+    for (size_t f = 0; f < numFunctions; ++f) {
+        CompiledExpr& function = functions[f];
+        function.numInputs = functionInputs[f];
+        function.code.assign(code.begin() + codeStart[f], code.begin() + codeStart[f + 1]);
+        if (function.numInputs < 0 || function.numInputs > 32) return false;
+
+        // The bytecode must leave exactly one value without ever running short of operands
+        int depth = 0;
+        for (const ExprInstr& instr : function.code) {
+            if (instr.op > OP_XOR || (instr.op == OP_INPUT && instr.arg >= function.numInputs)) return false;
+            depth += instr.op == OP_INPUT ? 1 : (instr.op == OP_NOT ? 0 : -1);
+            if (depth < 1) return false;
+        }
+        string error;
+        if (depth != 1 || !finishExpression(function, error)) return false; // Also tabulates it again
+    }
+
+    circuit.libraryGates.clear();
+    for (size_t t = 0; t < numTypes; ++t) {
+        circuit.libraryGates[typeNames[t]] = Gate(typeNames[t], vector<string>(typeInputs[t], ""), "", expressions[t], typeDelays[t], typeFunctions[t]);
+    }
+    circuit.functions = move(functions);
+    circuit.netlist = move(netlist);
+    circuit.settledStates = move(settledStates);
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef NETLISTCACHE_H
+#define NETLISTCACHE_H
+
+#include "CompiledExpr.h"
+#include "Gate.h"
+#include "Netlist.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Everything GateSimulator builds from a library and circuit file before the first event
+struct LoadedCircuit {
+    unordered_map<string, Gate>& libraryGates;
+    vector<CompiledExpr>& functions;
+    Netlist& netlist;
+    vector<uint8_t>& settledStates;
+};
+
+// Hash of a file's bytes, used to tell whether a cache still matches its source files
+bool hashFileContents(const string& path, uint64_t& hash);
+
+// Writes the loaded circuit to a versioned binary cache tagged with the source files' hashes.
+// The file is written next to 'path' and renamed into place, so readers never see half of it.
+bool saveNetlistCache(const string& path, uint64_t libraryHash, uint64_t circuitHash, const LoadedCircuit& circuit);
+
+// Loads a cache written by saveNetlistCache. Returns false, leaving 'circuit' to be rebuilt
+// from the source files, if the cache is missing, from another version, or made from other sources.
+bool loadNetlistCache(const string& path, uint64_t libraryHash, uint64_t circuitHash, LoadedCircuit circuit);
+
+#endif // NETLISTCACHE_H
@@ -0,0 +1,331 @@
+#include "NetlistOptimizer.h"
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+// A gate while the netlist is being rewritten
+struct WorkGate {
+    vector<int> inputs;
+    int function;
+    int delay;
+    int output;
+    int type;
+    bool alive = true;
+};
+
+class Optimizer {
+public:
+    Optimizer(Netlist& netlist, vector<CompiledExpr>& functions, const vector<uint8_t>& settledStates, const OptimizeScope& scope)
+        : netlist(netlist), functions(functions), settledStates(settledStates), scope(scope) {}
+
+    OptimizeStats run();
+
+private:
+    Netlist& netlist;
+    vector<CompiledExpr>& functions;
+    const vector<uint8_t>& settledStates;
+    const OptimizeScope& scope;
+    OptimizeStats stats;
+
+    vector<WorkGate> gates;
+    vector<vector<int>> readers; // Per signal, the live gates reading it, each once
+    vector<int> driverCount; // Per signal, the live gates driving it
+    vector<uint8_t> constant; // Per signal, whether it keeps its settled value for the whole run
+    vector<int> follows; // Per collapsed signal, the signal that changes exactly when it would have
+
+    // A signal another gate can absorb: one driver, and nothing outside the gates sees it
+    bool internal(int signal) const {
+        return driverCount[signal] == 1 && !scope.observed[signal] && !scope.stimulated[signal];
+    }
+
+    void removeReader(int signal, int gate);
+    bool rewriteGate(int gate, const vector<int>& newInputs, const vector<vector<ExprInstr>>& pinCode, int extraDelay, int newType);
+    void foldConstants();
+    void collapseSingleInputGates();
+    void removeDeadGates();
+    void rebuild();
+};
+
+void Optimizer::removeReader(int signal, int gate) {
+    vector<int>& list = readers[signal];
+    list.erase(remove(list.begin(), list.end(), gate), list.end());
+}
+
+// Gives 'gate' new inputs and a function in which each old input pin k is replaced by the
+// bytecode pinCode[k] over the new inputs. Returns false, changing nothing, if the function
+// would nest too deeply.
+bool Optimizer::rewriteGate(int gate, const vector<int>& newInputs, const vector<vector<ExprInstr>>& pinCode, int extraDelay, int newType) {
+    WorkGate& work = gates[gate];
+    CompiledExpr function;
+    function.numInputs = static_cast<int>(newInputs.size());
+    for (const ExprInstr& instr : functions[work.function].code) {
+        if (instr.op == OP_INPUT) {
+            const vector<ExprInstr>& replacement = pinCode[instr.arg];
+            function.code.insert(function.code.end(), replacement.begin(), replacement.end());
+        }
+        else {
+            function.code.push_back(instr);
+        }
+    }
+    string error;
+    if (!finishExpression(function, error)) return false;
+
+    for (int signal : work.inputs) {
+        removeReader(signal, gate);
+    }
+    work.inputs = newInputs;
+    for (int signal : work.inputs) {
+        if (find(readers[signal].begin(), readers[signal].end(), gate) == readers[signal].end()) readers[signal].push_back(gate);
+    }
+    work.function = static_cast<int>(functions.size());
+    functions.push_back(move(function));
+    work.delay += extraDelay;
+    work.type = newType;
+    return true;
+}
+
+// Takes the constant inputs into the gates reading them, repeating as removed gates make their outputs constant
+void Optimizer::foldConstants() {
+    vector<int> pending;
+    for (int gate = 0; gate < static_cast<int>(gates.size()); ++gate) pending.push_back(gate);
+
+    while (!pending.empty()) {
+        int gate = pending.back();
+        pending.pop_back();
+        WorkGate& work = gates[gate];
+        if (!work.alive) continue;
+
+        vector<int> newInputs;
+        vector<int> newPin(work.inputs.size(), -1);
+        for (size_t k = 0; k < work.inputs.size(); ++k) {
+            if (!constant[work.inputs[k]]) {
+                newPin[k] = static_cast<int>(newInputs.size());
+                newInputs.push_back(work.inputs[k]);
+            }
+        }
+        if (newInputs.size() == work.inputs.size()) continue;
+
+        int output = work.output;
+        if (newInputs.empty()) {
+            // The output never leaves its settled value, so readers can take it as a constant. The
+            // gate itself stays for now: removeDeadGates drops it once nothing observed reads it.
+            if (driverCount[output] == 1 && !scope.stimulated[output] && !constant[output]) {
+                constant[output] = 1;
+                for (int reader : readers[output]) pending.push_back(reader);
+            }
+            continue;
+        }
+
+        // A constant is written as x ^ x, inverted for 1, over any input that remains
+        vector<vector<ExprInstr>> pinCode(work.inputs.size());
+        for (size_t k = 0; k < work.inputs.size(); ++k) {
+            if (newPin[k] >= 0) {
+                pinCode[k] = { { OP_INPUT, static_cast<uint8_t>(newPin[k]) } };
+            }
+            else {
+                pinCode[k] = { { OP_INPUT, 0 }, { OP_INPUT, 0 }, { OP_XOR, 0 } };
+                if (settledStates[work.inputs[k]]) pinCode[k].push_back({ OP_NOT, 0 });
+            }
+        }
+        int folded = static_cast<int>(work.inputs.size() - newInputs.size());
+        if (rewriteGate(gate, newInputs, pinCode, 0, work.type)) {
+            stats.constantInputs += folded;
+        }
+    }
+}
+
+// Folds each buffer or inverter into the gate driving its input or into the gates reading its output,
+// where the timing allows it
+void Optimizer::collapseSingleInputGates() {
+    vector<int> driverOf(netlist.numSignals(), -1); // The driver of each signal with one
+    for (int gate = 0; gate < static_cast<int>(gates.size()); ++gate) {
+        if (gates[gate].alive) driverOf[gates[gate].output] = gate;
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int single = 0; single < static_cast<int>(gates.size()); ++single) {
+            WorkGate& work = gates[single];
+            if (!work.alive || work.inputs.size() != 1) continue;
+            int source = work.inputs[0];
+            int output = work.output;
+            if (source == output) continue;
+
+            // The gate takes in the driver of its input when nothing else sees that signal. Under transport
+            // delay every change of the driver reaches the output one gate delay later, so the pair is
+            // exactly one gate with the delays added.
+            int driver = driverOf[source];
+            if ((scope.zeroDelay || scope.transportDelay) && internal(source) && !constant[source] && readers[source].size() == 1
+                && driver != single && !gates[driver].inputs.empty()
+                && find(gates[driver].inputs.begin(), gates[driver].inputs.end(), output) == gates[driver].inputs.end()) {
+                const WorkGate& absorbed = gates[driver];
+                uint64_t table = functions[work.function].truthTable & 3;
+                int type = netlist.addType(netlist.typeNames[absorbed.type] + "+" + netlist.typeNames[work.type]);
+                if (rewriteGate(single, absorbed.inputs, { functions[absorbed.function].code }, scope.zeroDelay ? 0 : absorbed.delay, type)) {
+                    for (int signal : absorbed.inputs) removeReader(signal, driver);
+                    --driverCount[source];
+                    gates[driver].alive = false;
+                    if (table == 1 || table == 2) follows[source] = output; // Unless the single gate was constant
+                    ++stats.collapsedGates;
+                    changed = true;
+                    continue;
+                }
+            }
+
+            // In the levelized mode only the values after each time point matter, so the gate can also be
+            // merged into every gate reading its output
+            if (!scope.zeroDelay || !internal(output) || readers[output].empty()) continue;
+            vector<int> targets = readers[output];
+            for (int reader : targets) {
+                if (reader == single) continue;
+                WorkGate& target = gates[reader];
+
+                // The reader's pins on 'output' now read 'source' through the single gate's function
+                vector<int> newInputs;
+                vector<vector<ExprInstr>> pinCode(target.inputs.size());
+                for (size_t k = 0; k < target.inputs.size(); ++k) {
+                    int signal = target.inputs[k] == output ? source : target.inputs[k];
+                    auto found = find(newInputs.begin(), newInputs.end(), signal);
+                    uint8_t pin = static_cast<uint8_t>(found - newInputs.begin());
+                    if (found == newInputs.end()) newInputs.push_back(signal);
+
+                    if (target.inputs[k] == output) {
+                        for (const ExprInstr& instr : functions[work.function].code) {
+                            pinCode[k].push_back(instr.op == OP_INPUT ? ExprInstr{ OP_INPUT, pin } : instr);
+                        }
+                    }
+                    else {
+                        pinCode[k] = { { OP_INPUT, pin } };
+                    }
+                }
+                int type = netlist.addType(netlist.typeNames[work.type] + "+" + netlist.typeNames[target.type]);
+                rewriteGate(reader, newInputs, pinCode, 0, type);
+            }
+
+            if (readers[output].empty()) {
+                removeReader(source, single);
+                --driverCount[output];
+                work.alive = false;
+                ++stats.collapsedGates;
+                changed = true;
+            }
+        }
+    }
+}
+
+// Keeps only the gates an observed signal depends on
+void Optimizer::removeDeadGates() {
+    vector<vector<int>> drivers(netlist.numSignals());
+    for (int gate = 0; gate < static_cast<int>(gates.size()); ++gate) {
+        if (gates[gate].alive) drivers[gates[gate].output].push_back(gate);
+    }
+
+    vector<uint8_t> live(gates.size(), 0);
+    vector<int> pending;
+    for (int signal = 0; signal < netlist.numSignals(); ++signal) {
+        if (!scope.observed[signal]) continue;
+        for (int gate : drivers[signal]) {
+            live[gate] = 1;
+            pending.push_back(gate);
+        }
+    }
+    while (!pending.empty()) {
+        int gate = pending.back();
+        pending.pop_back();
+        for (int signal : gates[gate].inputs) {
+            for (int driver : drivers[signal]) {
+                if (!live[driver]) {
+                    live[driver] = 1;
+                    pending.push_back(driver);
+                }
+            }
+        }
+    }
+
+    for (int gate = 0; gate < static_cast<int>(gates.size()); ++gate) {
+        if (!gates[gate].alive || live[gate]) continue;
+        gates[gate].alive = false;
+        const vector<int>& inputs = gates[gate].inputs;
+        bool allConstant = all_of(inputs.begin(), inputs.end(), [&](int signal) { return constant[signal]; });
+        ++(allConstant ? stats.constantGates : stats.deadGates);
+    }
+}
+
+// Writes the remaining gates back into the netlist in their original order. Each keeps its name, stored
+// with it even if it was built from a module instance, since the instances' gate ids no longer run on.
+void Optimizer::rebuild() {
+    vector<string> names(gates.size());
+    for (size_t gate = 0; gate < gates.size(); ++gate) {
+        if (gates[gate].alive) names[gate] = netlist.gateName(static_cast<int>(gate));
+    }
+    for (Instance& instance : netlist.instances) {
+        instance.firstGate = instance.numGates = instance.gatesBefore = 0;
+    }
+    netlist.gateNames.clear();
+    netlist.gateIndex = NameIndex();
+    netlist.gateType.clear();
+    netlist.gateFunction.clear();
+    netlist.gateDelay.clear();
+    netlist.gateOutput.clear();
+    netlist.gateInputStart.assign(1, 0);
+    netlist.gateInputs.clear();
+    for (size_t gate = 0; gate < gates.size(); ++gate) {
+        const WorkGate& work = gates[gate];
+        if (!work.alive) continue;
+        netlist.addGate(names[gate], NameIndex::hash(names[gate]), work.type, work.function, work.delay, work.output, work.inputs);
+    }
+    netlist.buildFanout();
+}
+
+OptimizeStats Optimizer::run() {
+    int numSignals = netlist.numSignals();
+    stats.gatesBefore = netlist.numGates();
+    readers.assign(numSignals, {});
+    driverCount.assign(numSignals, 0);
+    gates.resize(netlist.numGates());
+    for (int gate = 0; gate < netlist.numGates(); ++gate) {
+        WorkGate& work = gates[gate];
+        work.inputs.assign(netlist.gateInputs.begin() + netlist.gateInputStart[gate], netlist.gateInputs.begin() + netlist.gateInputStart[gate + 1]);
+        work.function = netlist.gateFunction[gate];
+        work.delay = netlist.gateDelay[gate];
+        work.output = netlist.gateOutput[gate];
+        work.type = netlist.gateType[gate];
+        ++driverCount[work.output];
+    }
+    for (int signal = 0; signal < numSignals; ++signal) {
+        readers[signal].assign(netlist.fanoutGates.begin() + netlist.fanoutStart[signal], netlist.fanoutGates.begin() + netlist.fanoutStart[signal + 1]);
+    }
+    constant.assign(numSignals, 0);
+    for (int signal = 0; signal < numSignals; ++signal) {
+        constant[signal] = driverCount[signal] == 0 && !scope.stimulated[signal];
+    }
+
+    follows.assign(numSignals, -1);
+
+    foldConstants();
+    collapseSingleInputGates();
+    removeDeadGates();
+    rebuild();
+    stats.gatesAfter = netlist.numGates();
+
+    // Each change of a remaining signal stands for one of every collapsed signal that followed it
+    if (!scope.zeroDelay) {
+        stats.mirroredSignals.assign(numSignals, 0);
+        for (int signal = 0; signal < numSignals; ++signal) {
+            int kept = follows[signal];
+            while (kept >= 0 && follows[kept] >= 0) kept = follows[kept];
+            if (kept >= 0) ++stats.mirroredSignals[kept];
+        }
+    }
+    return stats;
+}
+
+} // namespace
+
+OptimizeStats optimizeNetlist(Netlist& netlist, vector<CompiledExpr>& functions, const vector<uint8_t>& settledStates,
+    const OptimizeScope& scope) {
+    return Optimizer(netlist, functions, settledStates, scope).run();
+}
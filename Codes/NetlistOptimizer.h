@@ -0,0 +1,56 @@
+#ifndef NETLISTOPTIMIZER_H
+#define NETLISTOPTIMIZER_H
+
+#include "CompiledExpr.h"
+#include "Netlist.h"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+using namespace std;
+
+// What the simulation after the optimization needs to see
+struct OptimizeScope {
+    vector<uint8_t> observed; // Per signal, whether its trace must stay the same
+    vector<uint8_t> stimulated; // Per signal, whether a stimulus drives it
+    bool zeroDelay = false; // Levelized: only the values after each time point matter
+    bool transportDelay = false; // Every change propagates, so gate delays simply add up along a path
+};
+
+// What optimizeNetlist removed or simplified
+struct OptimizeStats {
+    int gatesBefore = 0;
+    int gatesAfter = 0;
+    int constantGates = 0; // Every input constant
+    int constantInputs = 0; // Constant inputs folded into the function of a gate that stays
+    int collapsedGates = 0; // Buffers and inverters merged with the gate driving them or the gates reading them
+    int deadGates = 0; // No path to an observed signal
+    vector<uint32_t> mirroredSignals; // With gate delays, per signal, the collapsed signals that changed exactly when it does
+    uint64_t eventsSaved = 0; // The changes of the collapsed signals, counted by the simulation from 'mirroredSignals'
+    bool eventsCounted = false; // Whether a simulation filled in 'eventsSaved'
+
+    void print(ostream& out) const {
+        out << "Optimized netlist: " << gatesBefore << " gates -> " << gatesAfter << " (" << constantGates << " constant, "
+            << collapsedGates << " buffers/inverters collapsed, " << deadGates << " unobserved; "
+            << constantInputs << " constant inputs folded)";
+        if (eventsCounted) out << ", " << eventsSaved << " events of collapsed gates saved";
+        out << '\n';
+    }
+};
+
+// Simplifies 'netlist' in place, adding the functions it needs to 'functions', without changing
+// what the observed signals do:
+// - A signal no gate drives and no stimulus changes keeps its settled value, so the gates reading
+//   it take it into their function; a gate whose inputs are all constant is removed, unless it
+//   drives an observed signal.
+// - A single-input gate (buffer or inverter) takes in the gate driving its input when nothing
+//   else sees that signal. Under transport delay every change passes through both, so the pair
+//   is one gate with the delays added; inertial delay filters a chain of gates differently from
+//   one gate with the summed delay, so nothing is collapsed then. Without delays (levelized) a
+//   single-input gate is also folded into all the gates reading its unobserved output.
+// - Gates with no path to an observed signal are removed.
+// Signal ids and 'settledStates' stay valid; gates are renumbered and the fanout rebuilt.
+OptimizeStats optimizeNetlist(Netlist& netlist, vector<CompiledExpr>& functions, const vector<uint8_t>& settledStates,
+    const OptimizeScope& scope);
+
+#endif // NETLISTOPTIMIZER_H
@@ -0,0 +1,324 @@
+#include "ParallelSimulator.h"
+#include "SimulationRun.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+// Blocks each thread until all of them have arrived, then releases them together
+class WindowBarrier {
+public:
+    explicit WindowBarrier(int count) : count(count) {}
+
+    void wait() {
+        unique_lock<mutex> lock(guard);
+        int arrivedGeneration = generation;
+        if (++arrived == count) {
+            arrived = 0;
+            ++generation;
+            released.notify_all();
+            return;
+        }
+        released.wait(lock, [&] { return generation != arrivedGeneration; });
+    }
+
+private:
+    mutex guard;
+    condition_variable released;
+    int count;
+    int arrived = 0;
+    int generation = 0;
+};
+
+ParallelSimulator::ParallelSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay,
+    const vector<uint8_t>& settledStates, const SimOptions& options)
+    : netlist(netlist), functions(functions), options(options), maxDelay(maxDelay), settledStates(settledStates) {}
+
+bool ParallelSimulator::loadStimuli(const string& stimuliFile) {
+    bool parsed = stimuli.open(stimuliFile, [this](string_view signal) { return stimulusSignalId(netlist, extraSignals, signal); });
+    stimuli.loadAll(); // Every partition queues its stimuli up front
+    return parsed;
+}
+
+// Splits the gates into contiguous blocks of file order, keeping all drivers of a signal together
+// so its projected value lives in one place. Falls back to a single partition if a zero-delay
+// gate feeds another partition, as the windows would then have no length.
+void ParallelSimulator::partitionGates(int requested) {
+    int numGates = netlist.numGates();
+    numPartitions = max(1, min(requested, numGates));
+
+    for (;;) {
+        gatePartition.assign(numGates, 0);
+        signalOwner.assign(numSignals(), -1);
+        for (int gate = 0; gate < numGates; ++gate) {
+            int output = netlist.gateOutput[gate];
+            int block = static_cast<int>(static_cast<long long>(gate) * numPartitions / numGates);
+            if (signalOwner[output] < 0) signalOwner[output] = block;
+            gatePartition[gate] = signalOwner[output];
+        }
+
+        // Undriven signals are traced by the partition of their first reader
+        for (int signal = 0; signal < numSignals(); ++signal) {
+            if (signalOwner[signal] >= 0) continue;
+            bool read = signal < netlist.numSignals() && netlist.fanoutStart[signal] != netlist.fanoutStart[signal + 1];
+            signalOwner[signal] = read ? gatePartition[netlist.fanoutGates[netlist.fanoutStart[signal]]] : 0;
+        }
+
+        // Every signal goes to its owner and to each partition with a gate reading it
+        deliveryStart.assign(1, 0);
+        deliveryPartitions.clear();
+        vector<int> seen(numPartitions, -1);
+        for (int signal = 0; signal < numSignals(); ++signal) {
+            deliveryPartitions.push_back(signalOwner[signal]);
+            seen[signalOwner[signal]] = signal;
+            if (signal < netlist.numSignals()) {
+                for (uint32_t k = netlist.fanoutStart[signal]; k < netlist.fanoutStart[signal + 1]; ++k) {
+                    int reader = gatePartition[netlist.fanoutGates[k]];
+                    if (seen[reader] == signal) continue;
+                    seen[reader] = signal;
+                    deliveryPartitions.push_back(reader);
+                }
+            }
+            deliveryStart.push_back(static_cast<uint32_t>(deliveryPartitions.size()));
+        }
+
+        lookahead = INT_MAX;
+        for (int gate = 0; gate < numGates; ++gate) {
+            int output = netlist.gateOutput[gate];
+            if (deliveryStart[output + 1] - deliveryStart[output] > 1) {
+                lookahead = min(lookahead, netlist.gateDelay[gate]);
+            }
+        }
+        if (numPartitions == 1 || lookahead > 0) return;
+
+        cerr << "A zero-delay gate feeds another partition; simulating on one thread" << endl;
+        numPartitions = 1;
+    }
+}
+
+// Queues an event with every partition that needs it: locally right away, elsewhere at the window border
+void ParallelSimulator::schedule(Partition& part, int from, const Event& event) {
+    for (uint32_t k = deliveryStart[event.signal]; k < deliveryStart[event.signal + 1]; ++k) {
+        int to = deliveryPartitions[k];
+        if (to == from) {
+            part.events.push(event);
+        }
+        else {
+            part.outbox[to].push_back(event);
+        }
+    }
+}
+
+// Applies one timestamp's batch and evaluates the affected gates, as GateSimulator does, but only
+// for this partition's gates; the owner of each signal counts its events and records its trace lines
+void ParallelSimulator::processBatch(Partition& part, int index) {
+    part.stats.queueHighWater = max(part.stats.queueHighWater, part.events.size());
+    int time = part.events.popBatch(part.batch);
+    part.round = time == part.batchTime ? part.round + 1 : 0;
+    part.batchTime = time;
+
+    stable_sort(part.batch.begin(), part.batch.end(), [](const Event& a, const Event& b) { return a.signal < b.signal; });
+    for (const Event& event : part.batch) {
+        int signal = event.signal;
+        if (signalOwner[signal] == index) {
+            ++part.stats.eventsProcessed;
+            if (static_cast<size_t>(signal) < mirroredSignals.size() && part.signalStates[signal] != event.value) {
+                part.stats.eventsSaved += mirroredSignals[signal];
+            }
+        }
+        part.signalStates[signal] = static_cast<uint8_t>(event.value);
+
+        if (signalOwner[signal] == index && traced[signal] && (part.lastTraceTime[signal] != time || part.lastTraceValue[signal] != event.value)) {
+            part.lastTraceTime[signal] = time;
+            part.lastTraceValue[signal] = static_cast<uint8_t>(event.value);
+            part.records.push_back({ time, part.round, signal, event.value });
+            ++part.stats.traceLines;
+        }
+
+        if (signal >= netlist.numSignals()) continue; // Not part of the circuit
+        for (uint32_t k = netlist.fanoutStart[signal]; k < netlist.fanoutStart[signal + 1]; ++k) {
+            int gate = netlist.fanoutGates[k];
+            if (gatePartition[gate] == index && !part.gateDirty[gate]) {
+                part.gateDirty[gate] = 1;
+                part.dirtyGates.push_back(gate);
+            }
+        }
+    }
+
+    for (int gate : part.dirtyGates) {
+        part.gateDirty[gate] = 0;
+        int output = netlist.gateOutput[gate];
+        int newValue = computeGateOutput(netlist, functions, part.signalStates, gate);
+        ++part.stats.gateEvaluations;
+
+        // Inertial delay runs on one partition, so a cancelled event is in this partition's queue only
+        size_t cancelled = 0;
+        int dueTime = time + netlist.gateDelay[gate];
+        switch (updateGateOutput(output, newValue, dueTime, !options.transportDelay, part.signalStates, part.projectedStates, part.pendingTime,
+            part.events, cancelled)) {
+        case OutputUpdate::Unchanged:
+            break;
+        case OutputUpdate::Cancelled:
+            part.stats.eventsCancelled += cancelled;
+            break;
+        case OutputUpdate::Scheduled:
+            ++part.stats.outputToggles;
+            schedule(part, index, Event(dueTime, output, newValue));
+            break;
+        }
+    }
+    part.dirtyGates.clear();
+}
+
+// Writes the window's trace lines in the sequential simulator's order: by time, zero-delay
+// round, then signal. Lines of one signal all come from its owner, already in order.
+void ParallelSimulator::mergeTrace(TraceWriter& trace) {
+    vector<TraceRecord> merged;
+    for (Partition& part : partitions) {
+        merged.insert(merged.end(), part.records.begin(), part.records.end());
+        part.records.clear();
+    }
+    stable_sort(merged.begin(), merged.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        if (a.time != b.time) return a.time < b.time;
+        if (a.round != b.round) return a.round < b.round;
+        return a.signal < b.signal;
+    });
+    for (const TraceRecord& record : merged) {
+        trace.write(record.time, record.signal, record.value);
+    }
+}
+
+// One thread's share: hand over the mail, agree on the next window, run it, repeat
+void ParallelSimulator::worker(int index, WindowBarrier& barrier, TraceWriter& trace) {
+    Partition& part = partitions[index];
+    for (;;) {
+        for (Partition& sender : partitions) {
+            for (const Event& event : sender.outbox[index]) {
+                part.events.push(event);
+            }
+            sender.outbox[index].clear();
+        }
+        part.nextTime = part.events.nextTime();
+        barrier.wait();
+
+        int start = INT_MAX;
+        for (const Partition& other : partitions) {
+            start = min(start, other.nextTime);
+        }
+        if (start == INT_MAX) return; // Every queue and mailbox is empty
+        long long end = lookahead == INT_MAX ? INT_MAX : static_cast<long long>(start) + lookahead;
+
+        while (part.events.nextTime() < end) {
+            processBatch(part, index);
+        }
+        barrier.wait();
+
+        if (index == 0) {
+            ++windows;
+            mergeTrace(trace); // The others are only reading their mail meanwhile
+        }
+    }
+}
+
+bool ParallelSimulator::run(int numThreads) {
+    auto start = chrono::steady_clock::now();
+    stats = SimStats();
+    partitionGates(options.transportDelay ? numThreads : 1);
+    stats.initSeconds = secondsSince(start);
+    windows = 0;
+
+    partitions.clear();
+    partitions.reserve(numPartitions);
+    for (int index = 0; index < numPartitions; ++index) {
+        partitions.emplace_back(maxDelay + 1);
+        Partition& part = partitions.back();
+        part.signalStates = settledStates;
+        part.signalStates.resize(numSignals(), 0); // Signals outside the circuit start at 0
+        part.projectedStates = part.signalStates;
+        part.gateDirty.assign(netlist.numGates(), 0);
+        part.pendingTime.assign(netlist.numSignals(), INT_MIN);
+        part.lastTraceTime.assign(numSignals(), INT_MIN);
+        part.lastTraceValue.assign(numSignals(), 0);
+        part.outbox.resize(numPartitions);
+        part.batchTime = INT_MIN;
+    }
+    for (const Event& event : stimuli.loadAll()) {
+        for (uint32_t k = deliveryStart[event.signal]; k < deliveryStart[event.signal + 1]; ++k) {
+            partitions[deliveryPartitions[k]].events.push(event);
+        }
+    }
+
+    TraceWriter trace;
+    trace.configure(options.traceFormat, options.watchList);
+    if (!trace.open(options.outputFile, netlist, extraSignals)) {
+        cerr << "Failed to open .sim file for writing: " << options.outputFile << endl;
+        return false;
+    }
+    trace.writeInitialValues([&](int signal) { return partitions[0].signalStates[signal]; });
+    traced.resize(numSignals());
+    for (int signal = 0; signal < numSignals(); ++signal) {
+        traced[signal] = trace.watches(signal);
+    }
+
+    start = chrono::steady_clock::now();
+    WindowBarrier barrier(numPartitions);
+    vector<thread> threads;
+    for (int index = 1; index < numPartitions; ++index) {
+        threads.emplace_back(&ParallelSimulator::worker, this, index, ref(barrier), ref(trace));
+    }
+    worker(0, barrier, trace);
+    for (thread& t : threads) {
+        t.join();
+    }
+    bool written = trace.close();
+    stats.simulateSeconds = secondsSince(start);
+    if (!written) {
+        cerr << "Failed to write the trace file: " << options.outputFile << endl;
+    }
+
+    for (const Partition& part : partitions) {
+        stats.eventsProcessed += part.stats.eventsProcessed;
+        stats.gateEvaluations += part.stats.gateEvaluations;
+        stats.outputToggles += part.stats.outputToggles;
+        stats.traceLines += part.stats.traceLines;
+        stats.eventsCancelled += part.stats.eventsCancelled;
+        stats.eventsSaved += part.stats.eventsSaved;
+        stats.queueHighWater = max(stats.queueHighWater, part.stats.queueHighWater);
+    }
+
+    LOG_INFO("Parallel simulation complete: " << numPartitions << " partition(s), lookahead "
+        << (lookahead == INT_MAX ? string("unbounded") : to_string(lookahead)) << ", " << windows << " window(s).");
+    if (logEnabled(LOG_LEVEL_INFO)) {
+        stats.print(cout);
+    }
+    return written;
+}
+
+bool ParallelSimulator::reportScaling(int maxThreads) {
+    vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    double baseline = 0;
+    int verbosity = logVerbosity;
+    logVerbosity = min(logVerbosity, LOG_LEVEL_WARN); // Keeps the table together
+    cout << "Threads  Seconds  Speedup" << endl;
+    for (int threads : counts) {
+        auto begin = chrono::steady_clock::now();
+        if (!run(threads)) {
+            logVerbosity = verbosity;
+            return false;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        if (threads == 1) baseline = seconds;
+        cout << threads << "  " << seconds << "  " << (seconds > 0 ? baseline / seconds : 0) << endl;
+    }
+    logVerbosity = verbosity;
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef PARALLELSIMULATOR_H
+#define PARALLELSIMULATOR_H
+
+#include "CompiledExpr.h"
+#include "Event.h"
+#include "EventQueue.h"
+#include "Netlist.h"
+#include "SimOptions.h"
+#include "SimStats.h"
+#include "StimulusStream.h"
+#include "TraceWriter.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class WindowBarrier;
+
+// Event-driven simulation with the gates split into one partition per thread. Partitions
+// advance together in windows as long as the smallest delay of any gate whose output crosses
+// to another partition (the lookahead): nothing a partition sends can land inside the current
+// window, so each one runs its window alone and the threads only meet at the window borders,
+// where events for other partitions are handed over. Gates are evaluated and scheduled with the
+// functions SimulationRun uses, so the trace is identical to GateSimulator's.
+// Under inertial delay an event may be cancelled up to its own time, so no partition can run ahead of
+// the others and the gates stay in one partition; main warns about this.
+class ParallelSimulator {
+public:
+    // 'settledStates' are the signal values GateSimulator settled the circuit to
+    ParallelSimulator(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay, const vector<uint8_t>& settledStates,
+        const SimOptions& options);
+
+    // Reads the whole stimuli file, naming the signals outside the circuit as SimulationRun does
+    bool loadStimuli(const string& stimuliFile);
+
+    // Counts, as events saved, 'mirroredSignals[s]' for each change of signal s (see OptimizeStats)
+    void countSavedEvents(const vector<uint32_t>& mirroredSignals) { this->mirroredSignals = mirroredSignals; }
+
+    // Simulates the loaded stimuli on up to 'numThreads' threads and writes the trace
+    bool run(int numThreads);
+
+    // Runs the simulation with 1, 2, 4, ... up to 'maxThreads' threads and prints the timings
+    bool reportScaling(int maxThreads);
+
+    const SimStats& getStats() const { return stats; }
+
+private:
+    // A traced event; 'round' counts the zero-delay batches before it at the same time
+    struct TraceRecord {
+        int time;
+        int round;
+        int signal;
+        int value;
+    };
+
+    struct Partition {
+        EventQueue events;
+        vector<Event> batch;
+        vector<uint8_t> signalStates; // Current values of the signals this partition reads or owns
+        vector<uint8_t> projectedStates;
+        vector<int> pendingTime; // Inertial delay: time of the event scheduled on each signal
+        vector<int> dirtyGates;
+        vector<uint8_t> gateDirty;
+        vector<int> lastTraceTime;
+        vector<uint8_t> lastTraceValue;
+        vector<TraceRecord> records; // Trace lines of the current window, merged by the first thread
+        vector<vector<Event>> outbox; // Per destination partition, events to hand over at the window border
+        int nextTime = 0;
+        int batchTime = 0;
+        int round = 0;
+        SimStats stats;
+
+        explicit Partition(int horizon) : events(horizon) {}
+    };
+
+    const Netlist& netlist;
+    const vector<CompiledExpr>& functions;
+    SimOptions options;
+    int maxDelay;
+
+    const vector<uint8_t>& settledStates;
+    vector<string> extraSignals; // Stimulated signals the circuit does not use; ids follow the netlist's
+    StimulusStream stimuli;
+    vector<uint32_t> mirroredSignals;
+
+    int numPartitions = 1;
+    int lookahead = 0;
+    size_t windows = 0;
+    SimStats stats; // Totals over the partitions of the last run
+    vector<int> gatePartition;
+    vector<int> signalOwner; // Partition that traces the signal: the one driving it
+    vector<uint8_t> traced; // Per signal, whether the trace records it
+    vector<uint32_t> deliveryStart; // Per signal, the partitions that need its events (CSR)
+    vector<int> deliveryPartitions;
+    vector<Partition> partitions;
+
+    int numSignals() const { return netlist.numSignals() + static_cast<int>(extraSignals.size()); }
+    void partitionGates(int requested);
+    void schedule(Partition& part, int from, const Event& event);
+    void worker(int index, WindowBarrier& barrier, TraceWriter& trace);
+    void processBatch(Partition& part, int index);
+    void mergeTrace(TraceWriter& trace);
+};
+
+#endif // PARALLELSIMULATOR_H
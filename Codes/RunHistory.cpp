@@ -0,0 +1,106 @@
+#include "RunHistory.h"
+#include "BinaryFile.h"
+#include "InputParser.h"
+#include <cstdio>
+
+using namespace std;
+
+// Bump whenever the layout below or the meaning of any saved field changes
+static const uint32_t HISTORY_VERSION = 3;
+static const uint64_t HISTORY_MAGIC = 0x54534948534E434Cull; // "LCNSHIST" in memory order
+
+void packBits(const vector<uint8_t>& values, vector<uint64_t>& bits) {
+    bits.assign((values.size() + 63) / 64, 0);
+    for (size_t i = 0; i < values.size(); ++i) {
+        bits[i >> 6] |= static_cast<uint64_t>(values[i] & 1) << (i & 63);
+    }
+}
+
+void unpackBits(const vector<uint64_t>& bits, vector<uint8_t>& values) {
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = (bits[i >> 6] >> (i & 63)) & 1;
+    }
+}
+
+bool RunHistory::save(const string& path) const {
+    string partialPath = path + ".partial";
+    BinaryWriter out(partialPath);
+    if (!out.good()) return false;
+
+    out.value(HISTORY_MAGIC);
+    out.value(HISTORY_VERSION);
+    out.value(libraryHash);
+    out.value(circuitHash);
+    out.value(inertialDelay);
+    out.strings({ tracePath });
+    out.value(traceSize);
+    out.strings(extraSignals);
+    out.array(stimuli);
+    out.value(finalStats);
+    out.value<uint64_t>(checkpoints.size());
+    for (const Checkpoint& checkpoint : checkpoints) {
+        out.value(checkpoint.time);
+        out.value(checkpoint.traceOffset);
+        out.value(checkpoint.stats);
+        out.value<uint64_t>(checkpoint.segmentHighWater);
+        out.array(checkpoint.states);
+        out.array(checkpoint.projected);
+        out.array(checkpoint.pending);
+    }
+
+    bool ok = out.good();
+    ok = out.close() && ok;
+    if (!ok || rename(partialPath.c_str(), path.c_str()) != 0) {
+        remove(partialPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Reads a history and checks it fits a circuit of 'numSignals' signals; false if it is missing or unusable
+bool RunHistory::load(const string& path, int numSignals) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    BinaryReader in(file.text());
+
+    if (in.value<uint64_t>() != HISTORY_MAGIC || in.value<uint32_t>() != HISTORY_VERSION) return false;
+    libraryHash = in.value<uint64_t>();
+    circuitHash = in.value<uint64_t>();
+    inertialDelay = in.value<uint8_t>();
+    vector<string> paths;
+    in.strings(paths);
+    traceSize = in.value<uint64_t>();
+    in.strings(extraSignals);
+    in.array(stimuli);
+    finalStats = in.value<SimStats>();
+    uint64_t count = in.value<uint64_t>();
+    if (!in.good() || paths.size() != 1) return false;
+    tracePath = paths[0];
+
+    int totalSignals = numSignals + static_cast<int>(extraSignals.size());
+    size_t words = (totalSignals + 63) / 64;
+    for (const Event& event : stimuli) {
+        if (event.signal < 0 || event.signal >= totalSignals) return false;
+    }
+
+    checkpoints.clear();
+    for (uint64_t c = 0; c < count && in.good(); ++c) {
+        Checkpoint checkpoint;
+        checkpoint.time = in.value<int>();
+        checkpoint.traceOffset = in.value<uint64_t>();
+        checkpoint.stats = in.value<SimStats>();
+        checkpoint.segmentHighWater = in.value<uint64_t>();
+        in.array(checkpoint.states);
+        in.array(checkpoint.projected);
+        in.array(checkpoint.pending);
+        if (checkpoint.states.size() != words || checkpoint.projected.size() != words || checkpoint.traceOffset > traceSize
+            || (!checkpoints.empty() && checkpoint.time <= checkpoints.back().time)) {
+            return false;
+        }
+        for (const Event& event : checkpoint.pending) {
+            if (event.signal < 0 || event.signal >= numSignals || event.time < checkpoint.time) return false;
+        }
+        checkpoints.push_back(move(checkpoint));
+    }
+    return in.good();
+}
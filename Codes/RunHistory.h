@@ -0,0 +1,46 @@
+#ifndef RUNHISTORY_H
+#define RUNHISTORY_H
+
+#include "Event.h"
+#include "SimStats.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The state of an event-driven run at the start of a timestamp, once every earlier time has been processed
+struct Checkpoint {
+    int time = 0;
+    uint64_t traceOffset = 0; // Bytes of trace written before 'time'
+    SimStats stats; // Counters up to 'time'; queueHighWater is the most so far
+    size_t segmentHighWater = 0; // Most events pending at once between this checkpoint and the next
+    vector<uint64_t> states; // signalStates, one bit per signal
+    vector<uint64_t> projected; // projectedStates, one bit per signal
+    vector<Event> pending; // Gate events waiting at 'time', in the order they would be popped
+};
+
+// What an event-driven run leaves behind so the next run of the same circuit, with a slightly
+// different stimuli file, can start from the last checkpoint before the first changed stimulus
+struct RunHistory {
+    static const int MAX_CHECKPOINTS = 256; // Checkpoints are thinned out beyond this
+
+    uint64_t libraryHash = 0;
+    uint64_t circuitHash = 0;
+    uint8_t inertialDelay = 0; // Delay model the run used
+    string tracePath;
+    uint64_t traceSize = 0; // Size of the complete trace, to notice if it was changed since
+    vector<string> extraSignals; // Stimulated signals outside the circuit, as their ids were given
+    vector<Event> stimuli; // Sorted by time, in file order within a time
+    SimStats finalStats;
+    vector<Checkpoint> checkpoints; // In time order
+
+    bool load(const string& path, int numSignals);
+    bool save(const string& path) const;
+};
+
+// Packs 0/1 values into one bit each
+void packBits(const vector<uint8_t>& values, vector<uint64_t>& bits);
+void unpackBits(const vector<uint64_t>& bits, vector<uint8_t>& values);
+
+#endif // RUNHISTORY_H
@@ -0,0 +1,33 @@
+#ifndef SIMOPTIONS_H
+#define SIMOPTIONS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// File format of a trace: "time, signal, value" lines, a VCD waveform, or the indexed binary format
+enum class TraceFormat { Text, Vcd, Binary };
+
+// Settings chosen on the command line that change how a simulation runs or is recorded
+struct SimOptions {
+    string outputFile = "output.sim"; // Where the trace of processed events is written
+    string mode = "event"; // "event", "bitparallel", "levelized", "parallel", "fault", "batch", "server", "submit" or "stop-server"
+    string outputDir = "."; // Where the bit-parallel and batch modes write one trace per stimuli file
+    TraceFormat traceFormat = TraceFormat::Text;
+    vector<string> watchList; // Signal names or glob patterns to trace; empty traces every signal
+    string cacheFile; // Binary netlist cache to load from, or to write after parsing; empty disables it
+    string historyFile; // Event mode: checkpoints of the last run, to re-simulate only what a stimuli edit changes
+    string profileFile; // Event mode: where to write the per-gate and per-signal activity counts; empty disables profiling
+    size_t profileTop = 10; // Gates and signals listed in the hotspot report
+    string socketPath = "sim.sock"; // Unix socket of the simulation server
+    int threads = 0; // Threads for the parallel, fault, batch and server modes; 0 uses every hardware thread
+    int parseThreads = 1; // Threads tokenizing the circuit file; 1 parses it in a single pass
+    uint64_t checkpointEvents = 100000; // Events between the checkpoints kept in historyFile
+    bool transportDelay = false; // Every gate output change propagates; by default a pulse shorter than the gate delay is dropped
+    bool optimize = false; // Simplify the netlist for the stimuli and watch list before simulating
+    bool scalingReport = false; // Parallel mode: time the run on 1, 2, 4, ... threads
+};
+
+#endif // SIMOPTIONS_H
@@ -0,0 +1,54 @@
+#ifndef SIMSTATS_H
+#define SIMSTATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+// Counters and phase timings of one simulation run, printed once at the end
+struct SimStats {
+    uint64_t eventsProcessed = 0;
+    uint64_t gateEvaluations = 0;
+    uint64_t outputToggles = 0; // Gate evaluations that scheduled an output change
+    uint64_t traceLines = 0;
+    uint64_t eventsCancelled = 0; // Inertial delay: scheduled changes dropped because the output changed back first
+    uint64_t eventsSaved = 0; // --optimize: changes the collapsed gates would have made, printed with OptimizeStats
+    size_t queueHighWater = 0; // Most events pending at once
+    double parseSeconds = 0;
+    double initSeconds = 0;
+    double simulateSeconds = 0;
+
+    // Adds the counters and timings of another run; the high-water mark is the larger of the two
+    void add(const SimStats& other) {
+        eventsProcessed += other.eventsProcessed;
+        gateEvaluations += other.gateEvaluations;
+        outputToggles += other.outputToggles;
+        traceLines += other.traceLines;
+        eventsCancelled += other.eventsCancelled;
+        eventsSaved += other.eventsSaved;
+        queueHighWater = max(queueHighWater, other.queueHighWater);
+        parseSeconds += other.parseSeconds;
+        initSeconds += other.initSeconds;
+        simulateSeconds += other.simulateSeconds;
+    }
+
+    void print(ostream& out) const {
+        out << "Events processed: " << eventsProcessed << '\n'
+            << "Gate evaluations: " << gateEvaluations << '\n'
+            << "Output toggles: " << outputToggles << '\n'
+            << "Trace lines: " << traceLines << '\n'
+            << "Events cancelled: " << eventsCancelled << '\n'
+            << "Queue high-water mark: " << queueHighWater << '\n'
+            << "Time parsing: " << parseSeconds << " s, initializing: " << initSeconds
+            << " s, simulating: " << simulateSeconds << " s" << endl;
+    }
+};
+
+inline double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+#endif // SIMSTATS_H
@@ -0,0 +1,425 @@
+#include "SimulationRun.h"
+#include "InputParser.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+SimulationRun::SimulationRun(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay, const vector<uint8_t>& settledStates,
+    bool inertialDelay)
+    : netlist(netlist), functions(functions), maxDelay(maxDelay), inertialDelay(inertialDelay), signalStates(settledStates), projectedStates(settledStates),
+    events(maxDelay + 1) {} // Sizes the timing wheel so every gate delay lands inside it
+
+string SimulationRun::signalName(int signal) const {
+    return signal < netlist.numSignals() ? netlist.signalName(signal) : extraSignals[signal - netlist.numSignals()];
+}
+
+// Checks the stimuli file and names its signals; its events are read as the run reaches them. Inputs keep
+// their settled value until their event is processed.
+bool SimulationRun::loadStimuli(const string& stimuliFile) {
+    return stimuli.open(stimuliFile, [this](string_view signal) {
+        int id = stimulusSignalId(netlist, extraSignals, signal);
+        if (id == static_cast<int>(signalStates.size())) { // Signals outside the circuit are still traced
+            signalStates.push_back(0);
+            projectedStates.push_back(0);
+        }
+        return id;
+    });
+}
+
+void SimulationRun::enableHistory(const string& historyFile, uint64_t libraryHash, uint64_t circuitHash, uint64_t checkpointEvents) {
+    this->historyFile = historyFile;
+    this->checkpointEvents = max<uint64_t>(1, checkpointEvents);
+    history.libraryHash = libraryHash;
+    history.circuitHash = circuitHash;
+}
+
+void SimulationRun::enableProfile() {
+    profile = make_unique<ActivityProfile>();
+}
+
+bool SimulationRun::run(const string& outputFile) {
+    auto start = chrono::steady_clock::now();
+
+    gateDirty.assign(netlist.numGates(), 0);
+    pendingTime.assign(netlist.numSignals(), INT_MIN);
+    lastTraceTime.assign(signalStates.size(), INT_MIN);
+    lastTraceValue.assign(signalStates.size(), 0);
+    if (profile) profile->reset(netlist.numGates(), static_cast<int>(signalStates.size()));
+
+    // With a history, parts of the previous trace may be copied, so the new one is written beside it
+    string tracePath = historyFile.empty() ? outputFile : outputFile + ".partial";
+    bool ok = trace.open(tracePath, netlist, extraSignals);
+    if (!ok) {
+        cerr << "Failed to open .sim file for writing: " << tracePath << endl;
+    }
+    trace.writeInitialValues([&](int signal) { return signalStates[signal]; });
+    if (!historyFile.empty() && ok) {
+        ok = resume(outputFile);
+    }
+
+    bool rejoined = false;
+    bool checkpointDue = true;
+    int lastBatchTime = INT_MIN;
+    for (;;) {
+        int gateTime = events.nextTime();
+        int time = min(gateTime, stimuli.nextTime());
+        if (time == INT_MAX) break;
+
+        // At the start of each timestamp, the run may catch up with the previous one or leave a checkpoint
+        if (!historyFile.empty() && time != lastBatchTime) {
+            if (havePrevious && rejoinPrevious(time, lastBatchTime, outputFile, ok)) {
+                rejoined = true;
+                break;
+            }
+            if (checkpointDue || stats.eventsProcessed - eventsAtCheckpoint >= checkpointEvents) {
+                takeCheckpoint(time);
+                checkpointDue = false;
+            }
+        }
+        size_t pending = pendingEvents();
+        stats.queueHighWater = max(stats.queueHighWater, pending);
+        segmentHighWater = max(segmentHighWater, pending);
+        if (profile) profile->sampleQueue(time, pending);
+
+        // Takes every gate event of the earliest timestamp, behind the stimuli of that time
+        if (gateTime == time) {
+            events.popBatch(batch);
+        }
+        else {
+            events.skipTo(time); // So the events this batch schedules can still be cancelled
+            batch.clear();
+        }
+        if (stimuli.nextTime() == time) {
+            size_t gateEvents = batch.size();
+            stimuli.take(batch);
+            rotate(batch.begin(), batch.begin() + gateEvents, batch.end());
+        }
+        stats.eventsProcessed += batch.size();
+        lastBatchTime = time;
+
+        // Applies the batch in signal order, keeping file order for repeated signals
+        stable_sort(batch.begin(), batch.end(), [](const Event& a, const Event& b) { return a.signal < b.signal; });
+        for (const Event& event : batch) {
+            processEvent(event);
+        }
+        evaluateDirtyGates(time); // Evaluates each affected gate once against the final values of this timestamp
+    }
+
+    if (!historyFile.empty()) {
+        if (!rejoined && !history.checkpoints.empty()) {
+            history.checkpoints.back().segmentHighWater = max(history.checkpoints.back().segmentHighWater, segmentHighWater);
+        }
+        history.traceSize = trace.bytesWritten();
+        history.finalStats = stats;
+    }
+    // The trace is already in time order without repetitions
+    if (!trace.close() && ok) {
+        cerr << "Failed to write the trace file: " << tracePath << endl;
+        ok = false;
+    }
+
+    if (!historyFile.empty() && ok) {
+        if (rename(tracePath.c_str(), outputFile.c_str()) != 0) {
+            cerr << "Failed to replace " << outputFile << " with the new trace" << endl;
+            ok = false;
+        }
+        else if (!history.save(historyFile)) {
+            LOG_WARN("Failed to write the run history " << historyFile);
+        }
+    }
+    stats.simulateSeconds += secondsSince(start);
+    return ok;
+}
+
+// Sets up this run to continue the previous one from its last checkpoint before the first changed
+// stimulus, copying the trace written up to there. Returns false if the trace could not be copied.
+bool SimulationRun::resume(const string& outputFile) {
+    history.tracePath = outputFile;
+    history.inertialDelay = inertialDelay;
+    history.extraSignals = extraSignals;
+    history.stimuli = stimuli.loadAll(); // The history keeps every stimulus to compare with the next run
+    const vector<Event>& after = history.stimuli;
+
+    ifstream oldTrace(outputFile, ios_base::binary | ios_base::ate);
+    havePrevious = previous.load(historyFile, netlist.numSignals()) && previous.libraryHash == history.libraryHash
+        && previous.circuitHash == history.circuitHash
+        && previous.inertialDelay == history.inertialDelay && previous.tracePath == outputFile && previous.extraSignals == extraSignals
+        && oldTrace.is_open() && static_cast<uint64_t>(oldTrace.tellg()) == previous.traceSize;
+    if (!havePrevious) {
+        return true;
+    }
+
+    // The stimuli are the same before 'firstChange', and from any time after 'lastChange' on
+    auto same = [](const Event& a, const Event& b) { return a.time == b.time && a.signal == b.signal && a.value == b.value; };
+    const vector<Event>& before = previous.stimuli;
+    size_t i = 0;
+    while (i < before.size() && i < after.size() && same(before[i], after[i])) ++i;
+    int firstChange = min(i < before.size() ? before[i].time : INT_MAX, i < after.size() ? after[i].time : INT_MAX);
+    size_t a = before.size(), b = after.size();
+    while (a > i && b > i && same(before[a - 1], after[b - 1])) {
+        --a;
+        --b;
+    }
+    lastChange = max(a > 0 ? before[a - 1].time : INT_MIN, b > 0 ? after[b - 1].time : INT_MIN);
+
+    size_t c = 0;
+    while (c < previous.checkpoints.size() && previous.checkpoints[c].time <= firstChange) ++c;
+    if (c == 0) {
+        LOG_INFO("The stimuli changed before the first checkpoint at time " << previous.checkpoints.front().time << "; simulating from the start.");
+        nextPrevious = 0;
+        return true;
+    }
+
+    const Checkpoint& checkpoint = previous.checkpoints[c - 1];
+    if (!trace.appendFileRange(outputFile, 0, checkpoint.traceOffset)) {
+        cerr << "Failed to copy the previous trace from " << outputFile << endl;
+        return false;
+    }
+    unpackBits(checkpoint.states, signalStates);
+    unpackBits(checkpoint.projected, projectedStates);
+    events = EventQueue(maxDelay + 1);
+    for (const Event& event : checkpoint.pending) {
+        events.push(event);
+        pendingTime[event.signal] = event.time;
+    }
+    stimuli.skipTo(checkpoint.time);
+
+    double parseSeconds = stats.parseSeconds;
+    stats = checkpoint.stats;
+    stats.parseSeconds = parseSeconds;
+    stats.initSeconds = stats.simulateSeconds = 0;
+    eventsAtCheckpoint = stats.eventsProcessed;
+
+    // The earlier checkpoints stay as they were, except that every pending count before the first change
+    // counts the stimuli still to come, which may now be more or fewer; this one is taken again when the run starts
+    ptrdiff_t moreStimuli = static_cast<ptrdiff_t>(after.size()) - static_cast<ptrdiff_t>(before.size());
+    auto adjust = [&](size_t& highWater) {
+        if (highWater > 0) highWater += moreStimuli;
+    };
+    adjust(stats.queueHighWater);
+    history.checkpoints.assign(previous.checkpoints.begin(), previous.checkpoints.begin() + (c - 1));
+    for (Checkpoint& earlier : history.checkpoints) {
+        adjust(earlier.stats.queueHighWater);
+        adjust(earlier.segmentHighWater);
+    }
+    nextPrevious = c - 1;
+    LOG_INFO("Resuming the previous run at time " << checkpoint.time << "; the first changed stimulus is at time " << firstChange << ".");
+    return true;
+}
+
+// Called at the start of the timestamp 'time'. If the state now matches one of the previous run's
+// checkpoints and the stimuli are unchanged from there on, the rest of this run would repeat the
+// previous one, so its trace and checkpoints are copied instead and the run ends.
+bool SimulationRun::rejoinPrevious(int time, int lastBatchTime, const string& outputFile, bool& ok) {
+    vector<uint64_t> states, projected;
+    vector<Event> pending;
+    auto same = [](const Event& a, const Event& b) { return a.time == b.time && a.signal == b.signal && a.value == b.value; };
+
+    for (; nextPrevious < previous.checkpoints.size() && previous.checkpoints[nextPrevious].time <= time; ++nextPrevious) {
+        const Checkpoint& checkpoint = previous.checkpoints[nextPrevious];
+        if (checkpoint.time <= lastBatchTime || checkpoint.time <= lastChange) continue;
+
+        // Nothing happened in this run between 'lastBatchTime' and 'time', so its state is the one at checkpoint.time
+        packBits(signalStates, states);
+        packBits(projectedStates, projected);
+        events.pending(pending);
+        if (states != checkpoint.states || projected != checkpoint.projected || pending.size() != checkpoint.pending.size()
+            || !equal(pending.begin(), pending.end(), checkpoint.pending.begin(), same)) {
+            continue;
+        }
+
+        uint64_t joinOffset = checkpoint.traceOffset;
+        uint64_t base = trace.bytesWritten();
+        if (!trace.appendFileRange(outputFile, joinOffset, previous.traceSize)) {
+            cerr << "Failed to copy the previous trace from " << outputFile << endl;
+            ok = false;
+            return true;
+        }
+        LOG_INFO("Rejoined the previous run at time " << checkpoint.time << "; the rest of its trace is reused.");
+
+        // Counters from here on grow as they did in the previous run
+        SimStats joinStats = checkpoint.stats;
+        auto shifted = [&](SimStats later) {
+            later.eventsProcessed = later.eventsProcessed - joinStats.eventsProcessed + stats.eventsProcessed;
+            later.gateEvaluations = later.gateEvaluations - joinStats.gateEvaluations + stats.gateEvaluations;
+            later.outputToggles = later.outputToggles - joinStats.outputToggles + stats.outputToggles;
+            later.traceLines = later.traceLines - joinStats.traceLines + stats.traceLines;
+            later.eventsCancelled = later.eventsCancelled - joinStats.eventsCancelled + stats.eventsCancelled;
+            return later;
+        };
+        if (!history.checkpoints.empty()) {
+            history.checkpoints.back().segmentHighWater = max(history.checkpoints.back().segmentHighWater, segmentHighWater);
+        }
+        size_t highWater = stats.queueHighWater;
+        for (size_t j = nextPrevious; j < previous.checkpoints.size(); ++j) {
+            Checkpoint later = move(previous.checkpoints[j]);
+            later.traceOffset = later.traceOffset - joinOffset + base;
+            later.stats = shifted(later.stats);
+            later.stats.queueHighWater = highWater;
+            highWater = max(highWater, later.segmentHighWater);
+            history.checkpoints.push_back(move(later));
+        }
+
+        SimStats finalStats = shifted(previous.finalStats);
+        finalStats.queueHighWater = highWater;
+        finalStats.parseSeconds = stats.parseSeconds;
+        finalStats.initSeconds = stats.initSeconds;
+        finalStats.simulateSeconds = stats.simulateSeconds;
+        stats = finalStats;
+        return true;
+    }
+    return false;
+}
+
+// Records the state at the start of 'time' and thins the checkpoints out once there are too many
+void SimulationRun::takeCheckpoint(int time) {
+    vector<Checkpoint>& checkpoints = history.checkpoints;
+    if (!checkpoints.empty()) {
+        checkpoints.back().segmentHighWater = max(checkpoints.back().segmentHighWater, segmentHighWater);
+    }
+    segmentHighWater = 0;
+
+    Checkpoint checkpoint;
+    checkpoint.time = time;
+    checkpoint.traceOffset = trace.bytesWritten();
+    checkpoint.stats = stats;
+    packBits(signalStates, checkpoint.states);
+    packBits(projectedStates, checkpoint.projected);
+    events.pending(checkpoint.pending);
+    checkpoints.push_back(move(checkpoint));
+    eventsAtCheckpoint = stats.eventsProcessed;
+
+    if (checkpoints.size() > RunHistory::MAX_CHECKPOINTS) {
+        // Keeps every other checkpoint; each kept one's segment now runs to the next kept one
+        size_t kept = 0;
+        for (size_t k = 0; k < checkpoints.size(); k += 2) {
+            size_t highWater = checkpoints[k].segmentHighWater;
+            if (k + 1 < checkpoints.size()) highWater = max(highWater, checkpoints[k + 1].segmentHighWater);
+            if (kept != k) checkpoints[kept] = move(checkpoints[k]);
+            checkpoints[kept++].segmentHighWater = highWater;
+        }
+        checkpoints.resize(kept);
+        checkpointEvents *= 2;
+    }
+}
+
+// Applies one event, traces it and marks the gates reading the signal for evaluation
+void SimulationRun::processEvent(const Event& event) {
+    LOG_TRACE("Processing event for signal: " << signalName(event.signal)
+        << ", value: " << event.value
+        << ", at time: " << event.time);
+
+    if (profile) {
+        ++profile->signalEvents[event.signal];
+        profile->signalChanges[event.signal] += signalStates[event.signal] != event.value;
+    }
+    if (static_cast<size_t>(event.signal) < mirroredSignals.size() && signalStates[event.signal] != event.value) {
+        stats.eventsSaved += mirroredSignals[event.signal];
+    }
+    signalStates[event.signal] = event.value;
+
+    // Writes the event to the trace, unless the same line was already written at this time
+    if (lastTraceTime[event.signal] != event.time || lastTraceValue[event.signal] != event.value) {
+        lastTraceTime[event.signal] = event.time;
+        lastTraceValue[event.signal] = event.value;
+        if (trace.write(event.time, event.signal, event.value)) { // Buffered; reaches the file in large blocks
+            ++stats.traceLines;
+        }
+    }
+
+    if (event.signal >= netlist.numSignals()) return; // Not part of the circuit
+    netlist.forEachReader(event.signal, [this](int gate) {
+        if (!gateDirty[gate]) {
+            gateDirty[gate] = 1;
+            dirtyGates.push_back(gate);
+        }
+    });
+}
+
+// Evaluates every gate whose inputs changed at 'time' and schedules events for outputs that change
+void SimulationRun::evaluateDirtyGates(int time) {
+    for (int gate : dirtyGates) {
+        gateDirty[gate] = 0;
+        Netlist::GateView view = netlist.gate(gate);
+        int output = view.output();
+        int oldOutputValue = projectedStates[output];
+        int newOutputValue = computeGateOutput(functions, signalStates, view);
+        ++stats.gateEvaluations;
+        if (profile) ++profile->gateEvaluations[gate];
+
+        LOG_TRACE("Gate " << netlist.gateName(gate) << " at time " << time
+            << " Evaluated. Old Output: " << oldOutputValue
+            << ", New Output: " << newOutputValue);
+
+        size_t cancelled = 0;
+        int dueTime = time + view.delay();
+        switch (updateGateOutput(output, newOutputValue, dueTime, inertialDelay, signalStates, projectedStates, pendingTime, events, cancelled)) {
+        case OutputUpdate::Unchanged:
+            break;
+        case OutputUpdate::Cancelled:
+            LOG_TRACE("Cancelled the event for " << netlist.signalName(output) << " at time " << pendingTime[output]);
+            stats.eventsCancelled += cancelled;
+            if (profile) profile->gateCancelled[gate] += cancelled;
+            break;
+        case OutputUpdate::Scheduled:
+            LOG_TRACE("Output change detected. Scheduling new event for " << netlist.signalName(output)
+                << " at time " << dueTime
+                << " with value " << newOutputValue);
+            ++stats.outputToggles;
+            if (profile) ++profile->gateScheduled[gate];
+            events.push(Event(dueTime, output, newOutputValue)); // Traced when processed
+            break;
+        }
+    }
+    dirtyGates.clear();
+}
+
+int stimulusSignalId(const Netlist& netlist, vector<string>& extraSignals, string_view signal) {
+    int id = netlist.findSignal(signal);
+    if (id >= 0) return id;
+    auto it = find(extraSignals.begin(), extraSignals.end(), signal);
+    if (it == extraSignals.end()) {
+        extraSignals.emplace_back(signal);
+        it = extraSignals.end() - 1;
+    }
+    return netlist.numSignals() + static_cast<int>(it - extraSignals.begin());
+}
+
+// Evaluates a gate by packing its current input states into bits and looking up its compiled expression
+int computeGateOutput(const vector<CompiledExpr>& functions, const vector<uint8_t>& states, const Netlist::GateView& gate) {
+    uint32_t packedInputs = 0;
+    uint32_t numInputs = gate.numInputs();
+
+    for (uint32_t k = 0; k < numInputs; ++k) {
+        packedInputs |= static_cast<uint32_t>(states[gate.input(k)] & 1) << k;
+    }
+    LOG_TRACE("Evaluating a gate with inputs packed as " << packedInputs);
+
+    return functions[gate.function()].evaluate(packedInputs);
+}
+
+int computeGateOutput(const Netlist& netlist, const vector<CompiledExpr>& functions, const vector<uint8_t>& states, int gate) {
+    return computeGateOutput(functions, states, netlist.gate(gate));
+}
+
+OutputUpdate updateGateOutput(int output, int newValue, int dueTime, bool inertialDelay, const vector<uint8_t>& signalStates,
+    vector<uint8_t>& projectedStates, vector<int>& pendingTime, EventQueue& events, size_t& cancelled) {
+    if (projectedStates[output] == newValue) return OutputUpdate::Unchanged;
+
+    projectedStates[output] = static_cast<uint8_t>(newValue); // Other gates keep seeing the old value until the event happens
+    if (inertialDelay && signalStates[output] == newValue) {
+        // The output returns to its current value before its scheduled change happens: the pulse
+        // is shorter than the gate delay, so the change is cancelled instead of propagated
+        cancelled += events.removeIf(pendingTime[output], [output](const Event& event) { return event.signal == output; });
+        return OutputUpdate::Cancelled;
+    }
+    pendingTime[output] = dueTime;
+    return OutputUpdate::Scheduled;
+}
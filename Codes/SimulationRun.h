@@ -0,0 +1,116 @@
+#ifndef SIMULATIONRUN_H
+#define SIMULATIONRUN_H
+
+#include "ActivityProfile.h"
+#include "CompiledExpr.h"
+#include "Event.h"
+#include "EventQueue.h"
+#include "Netlist.h"
+#include "RunHistory.h"
+#include "SimStats.h"
+#include "StimulusStream.h"
+#include "TraceWriter.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Id of a stimulated signal: its netlist id, or for a signal outside the circuit an id after the
+// netlist's, in the order the signals first appear in 'extraSignals'
+int stimulusSignalId(const Netlist& netlist, vector<string>& extraSignals, string_view signal);
+
+// Evaluates a gate on 'states' by packing its input values into bits for its compiled function
+int computeGateOutput(const vector<CompiledExpr>& functions, const vector<uint8_t>& states, const Netlist::GateView& gate);
+int computeGateOutput(const Netlist& netlist, const vector<CompiledExpr>& functions, const vector<uint8_t>& states, int gate);
+
+enum class OutputUpdate { Unchanged, Cancelled, Scheduled };
+
+// Takes a gate output's newly evaluated value, the same way in every event-driven engine. It is
+// compared with the value the output has once its pending events happen, so a change is scheduled
+// only once. Under inertial delay, a value back at the current one cancels the pending change in
+// 'events', adding the events dropped to 'cancelled'. Otherwise the change is recorded as due at
+// 'dueTime', and the caller queues its event.
+OutputUpdate updateGateOutput(int output, int newValue, int dueTime, bool inertialDelay, const vector<uint8_t>& signalStates,
+    vector<uint8_t>& projectedStates, vector<int>& pendingTime, EventQueue& events, size_t& cancelled);
+
+// The state of one event-driven simulation of a stimuli file. The netlist, compiled
+// functions and settled starting values are only read, so any number of runs can share
+// one loaded circuit, each on its own thread.
+class SimulationRun {
+public:
+    // With 'inertialDelay', a gate output that changes back before its scheduled change happens
+    // cancels that change, so pulses shorter than the gate delay never propagate; otherwise
+    // every change propagates (transport delay)
+    SimulationRun(const Netlist& netlist, const vector<CompiledExpr>& functions, int maxDelay, const vector<uint8_t>& settledStates,
+        bool inertialDelay);
+
+    // Opens a stimuli file, whose events are read as the run reaches their times; signals outside
+    // the circuit get ids after the netlist's
+    bool loadStimuli(const string& stimuliFile);
+
+    // Keeps checkpoints of this run in 'historyFile', and starts from the previous run's
+    // checkpoints there when only part of the stimuli changed. The hashes identify the circuit.
+    void enableHistory(const string& historyFile, uint64_t libraryHash, uint64_t circuitHash, uint64_t checkpointEvents);
+
+    // Chooses the trace format and the signals it records; by default every signal, as text
+    void configureTrace(TraceFormat format, const vector<string>& watchList) { trace.configure(format, watchList); }
+
+    // Counts the activity of every gate and signal and samples the queue depth while the run goes
+    void enableProfile();
+
+    // Counts, as events saved, 'mirroredSignals[s]' for each change of signal s (see OptimizeStats)
+    void countSavedEvents(const vector<uint32_t>& mirroredSignals) { this->mirroredSignals = mirroredSignals; }
+
+    // Processes every scheduled event and writes the trace to 'outputFile'
+    bool run(const string& outputFile);
+
+    size_t pendingEvents() const { return events.size() + stimuli.remaining(); }
+    const SimStats& getStats() const { return stats; }
+    const ActivityProfile* getProfile() const { return profile.get(); } // Null unless enableProfile was called
+    const vector<string>& getExtraSignals() const { return extraSignals; }
+
+private:
+    const Netlist& netlist;
+    const vector<CompiledExpr>& functions;
+    int maxDelay;
+    bool inertialDelay;
+
+    vector<string> extraSignals; // Stimulated signals the circuit does not use
+    vector<uint8_t> signalStates; // Current value of each signal, indexed by signal id
+    vector<uint8_t> projectedStates; // Value of each gate output once its scheduled events have happened
+    StimulusStream stimuli; // In time order; applied before the gate events of the same time
+    EventQueue events; // Pending gate events, popped one timestamp at a time
+    vector<int> pendingTime; // Inertial delay: time of the event scheduled on each signal, valid while projected differs from current
+    vector<Event> batch; // Events of the timestamp being processed
+    vector<int> dirtyGates; // Gates whose inputs changed at the current timestamp
+    vector<uint8_t> gateDirty; // Marks gates already in dirtyGates
+    TraceWriter trace;
+    vector<int> lastTraceTime; // Time of the last trace line per signal, to drop repeated lines
+    vector<uint8_t> lastTraceValue;
+    SimStats stats;
+    unique_ptr<ActivityProfile> profile;
+    vector<uint32_t> mirroredSignals; // Empty unless countSavedEvents was called
+
+    // Incremental re-simulation, used when enableHistory was called
+    string historyFile;
+    RunHistory history; // This run's, filled in as it goes
+    RunHistory previous; // The last run's, if it can be reused
+    bool havePrevious = false;
+    size_t nextPrevious = 0; // Next of the previous run's checkpoints this run may rejoin
+    int lastChange = 0; // From the first previous checkpoint after this time, the stimuli are unchanged
+    uint64_t checkpointEvents = 0; // Events between checkpoints
+    uint64_t eventsAtCheckpoint = 0;
+    size_t segmentHighWater = 0;
+
+    string signalName(int signal) const;
+    void processEvent(const Event& event);
+    void evaluateDirtyGates(int time);
+
+    bool resume(const string& outputFile);
+    bool rejoinPrevious(int time, int lastBatchTime, const string& outputFile, bool& ok);
+    void takeCheckpoint(int time);
+};
+
+#endif // SIMULATIONRUN_H
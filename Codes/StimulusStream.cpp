@@ -0,0 +1,181 @@
+#include "StimulusStream.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+// Calls onEvent(time, signal, value) for every valid line of a stimuli file, reading it a chunk at
+// a time. With 'report', malformed lines are reported and make it return false.
+template <typename EventHandler>
+static bool readStimuli(const string& path, bool report, EventHandler onEvent) {
+    LineReader reader;
+    if (!reader.open(path)) {
+        cerr << "Failed to open stimuli file: " << path << endl;
+        return false;
+    }
+    bool ok = true;
+    vector<Token> tokens;
+    string error;
+    string_view line;
+    for (int lineNumber = 1; reader.next(line); ++lineNumber) {
+        tokenizeLine(line, tokens);
+        if (tokens.empty()) continue;
+        int time = 0, value = 0;
+        uint32_t column = 0;
+        if (parseStimulusLine(tokens, time, value, error, column)) {
+            onEvent(time, tokens[1].text, value);
+        }
+        else if (report) {
+            reportParseError(path, lineNumber, column, error);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool StimulusStream::open(const string& path, SignalId signalId, size_t runEvents) {
+    this->path = path;
+    this->signalId = move(signalId);
+    total = taken = 0;
+    buffer.clear();
+    next = 0;
+    reading = false;
+    runs.clear();
+    heads = {};
+
+    // Checks every line and names every signal before the simulation starts, so the trace can list them
+    bool sorted = true;
+    int lastTime = INT_MIN;
+    bool ok = readStimuli(path, true, [&](int time, string_view signal, int) {
+        this->signalId(signal);
+        sorted = sorted && time >= lastTime;
+        lastTime = time;
+        ++total;
+    });
+
+    if (sorted) {
+        reading = reader.open(path);
+        if (!reading) { // Already reported
+            total = 0;
+            return false;
+        }
+    }
+    else if (!spillRuns(max<size_t>(runEvents, 1))) {
+        runs.clear();
+        heads = {};
+        total = 0;
+        return false;
+    }
+    refill();
+    return ok;
+}
+
+// Cuts the file into sorted runs of 'runEvents' events. A single run stays in the buffer; otherwise
+// each goes to its own temporary file, removed once it is closed.
+bool StimulusStream::spillRuns(size_t runEvents) {
+    bool ok = true;
+    vector<Event> run;
+    auto spill = [&]() {
+        stable_sort(run.begin(), run.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+        Run spilled;
+        spilled.file.reset(tmpfile());
+        if (!spilled.file || fwrite(run.data(), sizeof(Event), run.size(), spilled.file.get()) != run.size()
+            || fflush(spilled.file.get()) != 0) {
+            cerr << "Failed to write a temporary file to sort the stimuli of " << path << endl;
+            ok = false;
+        }
+        else {
+            rewind(spilled.file.get());
+            runs.push_back(move(spilled));
+        }
+        run.clear();
+    };
+    bool read = readStimuli(path, false, [&](int time, string_view signal, int value) {
+        if (!ok) return;
+        run.emplace_back(time, signalId(signal), value);
+        if (run.size() == runEvents) spill();
+    });
+    if (!read) ok = false;
+    if (!ok) return false;
+
+    if (runs.empty()) {
+        stable_sort(run.begin(), run.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+        buffer = move(run);
+        return true;
+    }
+    if (!run.empty()) spill();
+    for (size_t r = 0; ok && r < runs.size(); ++r) {
+        if (readRun(runs[r])) heads.push({ runs[r].events[0].time, r });
+    }
+    return ok;
+}
+
+// Reads the next events of a spilled run; returns false once it has none left
+bool StimulusStream::readRun(Run& run) {
+    run.events.resize(BUFFER_EVENTS);
+    run.events.resize(fread(run.events.data(), sizeof(Event), BUFFER_EVENTS, run.file.get()));
+    run.next = 0;
+    return !run.events.empty();
+}
+
+// Replaces the events already taken with the next block from the file or the runs
+void StimulusStream::refill() {
+    buffer.erase(buffer.begin(), buffer.begin() + next);
+    next = 0;
+    readUntil(BUFFER_EVENTS);
+}
+
+// Reads events into the buffer until it holds 'limit' or the file or runs run out
+void StimulusStream::readUntil(size_t limit) {
+    string error;
+    string_view line;
+    while (reading && buffer.size() < limit) {
+        if (!reader.next(line)) {
+            reading = false;
+            break;
+        }
+        tokenizeLine(line, tokens);
+        int time = 0, value = 0;
+        uint32_t column = 0;
+        if (!tokens.empty() && parseStimulusLine(tokens, time, value, error, column)) {
+            buffer.emplace_back(time, signalId(tokens[1].text), value);
+        }
+    }
+
+    while (buffer.size() < limit && !heads.empty()) {
+        size_t r = heads.top().run;
+        heads.pop();
+        Run& run = runs[r];
+        buffer.push_back(run.events[run.next++]);
+        if (run.next < run.events.size() || readRun(run)) {
+            heads.push({ run.events[run.next].time, r });
+        }
+    }
+    if (heads.empty()) runs.clear();
+}
+
+void StimulusStream::take(vector<Event>& out) {
+    int time = nextTime();
+    while (next < buffer.size() && buffer[next].time == time) {
+        out.push_back(buffer[next++]);
+        ++taken;
+        if (next == buffer.size()) refill(); // Events of this time may go on in the next block
+    }
+}
+
+void StimulusStream::skipTo(int time) {
+    while (next < buffer.size() && buffer[next].time < time) {
+        ++next;
+        ++taken;
+        if (next == buffer.size()) refill();
+    }
+}
+
+const vector<Event>& StimulusStream::loadAll() {
+    buffer.erase(buffer.begin(), buffer.begin() + next);
+    next = 0;
+    buffer.reserve(remaining());
+    readUntil(SIZE_MAX);
+    return buffer;
+}
@@ -0,0 +1,91 @@
+#ifndef STIMULUSSTREAM_H
+#define STIMULUSSTREAM_H
+
+#include "Event.h"
+#include "InputParser.h"
+#include <climits>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Hands the events of a stimuli file to a simulation in time order, a few thousand at a time,
+// so memory does not grow with the length of the file. Events with equal times keep their file
+// order. open() reads the file once to report malformed lines, give every signal its id and see
+// whether the times ever go back:
+// - A file in time order is then read again, a chunk at a time, as the simulation reaches each time.
+// - Otherwise it is sorted externally: cut into runs of up to 'runEvents' events, each sorted
+//   and spilled to a temporary file, and the runs are merged as the simulation reads them. A
+//   file that fits in one run is just sorted in memory.
+class StimulusStream {
+public:
+    static const size_t RUN_EVENTS = 1 << 20; // Events sorted in memory at once, 16 MB
+    static const size_t BUFFER_EVENTS = 4096; // Events read ahead from the file or from each run
+
+    using SignalId = function<int(string_view)>; // Id of a stimulated signal; called again for each read
+
+    // Returns false if the file could not be read or had malformed lines; the valid lines still count
+    bool open(const string& path, SignalId signalId, size_t runEvents = RUN_EVENTS);
+
+    size_t size() const { return total; }
+    size_t remaining() const { return total - taken; }
+
+    // Time of the next event, or INT_MAX once every event was taken
+    int nextTime() const { return next < buffer.size() ? buffer[next].time : INT_MAX; }
+
+    // Appends every event at the next time to 'out'
+    void take(vector<Event>& out);
+
+    // Drops every event before 'time'
+    void skipTo(int time);
+
+    // Reads every event left into memory, which is then all the stream takes from
+    const vector<Event>& loadAll();
+
+private:
+    struct FileCloser {
+        void operator()(FILE* file) const { fclose(file); }
+    };
+
+    // A sorted run spilled to a temporary file and the events read ahead from it
+    struct Run {
+        unique_ptr<FILE, FileCloser> file;
+        vector<Event> events;
+        size_t next = 0;
+    };
+
+    // The next event of a run; ties go to the earlier run, which holds the earlier lines
+    struct RunHead {
+        int time;
+        size_t run;
+        bool operator>(const RunHead& other) const {
+            return time != other.time ? time > other.time : run > other.run;
+        }
+    };
+
+    string path;
+    SignalId signalId;
+    size_t total = 0;
+    size_t taken = 0;
+    vector<Event> buffer; // Events read ahead, in time order
+    size_t next = 0; // First of them not taken yet
+
+    LineReader reader; // Sorted file: where the lines not read yet start
+    bool reading = false;
+
+    vector<Run> runs; // Unsorted file: the runs being merged
+    priority_queue<RunHead, vector<RunHead>, greater<RunHead>> heads; // Of the runs with events left
+    vector<Token> tokens;
+
+    bool spillRuns(size_t runEvents);
+    bool readRun(Run& run);
+    void refill();
+    void readUntil(size_t limit);
+};
+
+#endif // STIMULUSSTREAM_H
@@ -0,0 +1,215 @@
+#include "TraceConvert.h"
+#include "BinaryFile.h"
+#include "InputParser.h"
+#include "TraceWriter.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Reads a varint at 'at', moving it past; false if the data ends first
+static bool readVarint(const char*& at, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; at < end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*at++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+static bool convertBinary(string_view data, const string& path, const string& outputFile, int fromTime) {
+    const size_t trailerSize = 3 * sizeof(uint64_t);
+    const size_t entrySize = 2 * sizeof(int) + sizeof(uint64_t); // First and last time, offset
+    const size_t blockHeaderSize = 2 * sizeof(int) + sizeof(uint32_t); // First time, records, bytes
+    BinaryReader header(data);
+    bool valid = header.value<uint64_t>() == TraceWriter::BINARY_MAGIC && header.value<uint32_t>() == TraceWriter::BINARY_VERSION;
+    vector<string> names;
+    header.strings(names);
+    valid = valid && header.good() && data.size() >= trailerSize;
+
+    // The index of the blocks is at the end of the file
+    uint64_t count = 0, indexOffset = 0;
+    if (valid) {
+        BinaryReader trailer(data.substr(data.size() - trailerSize));
+        count = trailer.value<uint64_t>();
+        indexOffset = trailer.value<uint64_t>();
+        valid = trailer.value<uint64_t>() == TraceWriter::BINARY_INDEX_MAGIC && indexOffset <= data.size() - trailerSize
+            && count * entrySize == data.size() - trailerSize - indexOffset;
+    }
+    if (!valid) {
+        cerr << "Not a binary trace, or a damaged one: " << path << endl;
+        return false;
+    }
+    vector<int> lastTimes(count);
+    vector<uint64_t> offsets(count);
+    BinaryReader index(data.substr(indexOffset));
+    for (uint64_t k = 0; k < count; ++k) {
+        index.value<int>(); // First time
+        lastTimes[k] = index.value<int>();
+        offsets[k] = index.value<uint64_t>();
+    }
+
+    TraceWriter text;
+    if (!text.open(outputFile, names)) {
+        cerr << "Failed to open .sim file for writing: " << outputFile << endl;
+        return false;
+    }
+
+    // Skips the blocks that end before 'fromTime'
+    size_t first = lower_bound(lastTimes.begin(), lastTimes.end(), fromTime) - lastTimes.begin();
+    for (size_t k = first; k < count; ++k) {
+        bool damaged = offsets[k] + blockHeaderSize > indexOffset;
+        int time = 0;
+        uint32_t records = 0, bytes = 0;
+        if (!damaged) {
+            BinaryReader block(data.substr(offsets[k], blockHeaderSize));
+            time = block.value<int>();
+            records = block.value<uint32_t>();
+            bytes = block.value<uint32_t>();
+            damaged = offsets[k] + blockHeaderSize + bytes > indexOffset;
+        }
+
+        const char* at = data.data() + offsets[k] + blockHeaderSize;
+        const char* end = at + bytes;
+        for (uint32_t r = 0; r < records && !damaged; ++r) {
+            uint64_t delta, record;
+            if (!readVarint(at, end, delta) || !readVarint(at, end, record) || record / 2 >= names.size()) {
+                damaged = true;
+                break;
+            }
+            time += static_cast<int>(static_cast<int64_t>(delta >> 1) ^ -static_cast<int64_t>(delta & 1));
+            if (time >= fromTime) {
+                text.write(time, static_cast<int>(record / 2), static_cast<int>(record & 1));
+            }
+        }
+        if (damaged) {
+            cerr << "Damaged block in binary trace: " << path << endl;
+            return false;
+        }
+    }
+    if (!text.close()) {
+        cerr << "Failed to write the trace file: " << outputFile << endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the 1-bit wires of a VCD file; vectors and x or z values are skipped. A wire inside nested
+// scopes is named by the scopes below the outermost one, "u1/f0/t", as the trace writer declares it.
+// The $dumpvars values are the state before the first change, which a text trace does not hold.
+static bool convertVcd(string_view data, const string& outputFile, int fromTime) {
+    vector<string> names;
+    unordered_map<string_view, int> codes;
+    vector<string_view> scopes;
+    TraceWriter text;
+    bool body = false;
+    bool skipping = false; // Inside a $comment, $date or other block without value changes
+    bool initial = false; // Inside $dumpvars
+    long long time = 0;
+
+    auto next = [&](size_t& at) {
+        while (at < data.size() && isspace(static_cast<unsigned char>(data[at]))) ++at;
+        size_t start = at;
+        while (at < data.size() && !isspace(static_cast<unsigned char>(data[at]))) ++at;
+        return data.substr(start, at - start);
+    };
+
+    for (size_t at = 0; at < data.size();) {
+        string_view token = next(at);
+        if (token.empty()) break;
+        if (skipping) {
+            skipping = token != "$end";
+        }
+        else if (token == "$var") {
+            next(at); // Type
+            string_view size = next(at), code = next(at), name = next(at);
+            if (size == "1") {
+                string path;
+                for (size_t k = 1; k < scopes.size(); ++k) {
+                    path.append(scopes[k]).append(1, '/');
+                }
+                codes.emplace(code, static_cast<int>(names.size()));
+                names.push_back(path.append(name));
+            }
+            skipping = true; // Up to the $end, past any bit range
+        }
+        else if (token == "$scope") {
+            next(at); // Type
+            scopes.push_back(next(at));
+            skipping = true;
+        }
+        else if (token == "$upscope") {
+            if (!scopes.empty()) scopes.pop_back();
+            skipping = true;
+        }
+        else if (token == "$enddefinitions") {
+            skipping = true;
+            body = true;
+            if (!text.open(outputFile, names)) {
+                cerr << "Failed to open .sim file for writing: " << outputFile << endl;
+                return false;
+            }
+        }
+        else if (token == "$dumpvars") {
+            initial = true;
+        }
+        else if (token == "$end") {
+            initial = false;
+        }
+        else if (token == "$dumpon" || token == "$dumpoff" || token == "$dumpall") {
+            // Their value changes are read like any others
+        }
+        else if (token[0] == '$') {
+            skipping = true;
+        }
+        else if (!body) {
+            continue;
+        }
+        else if (token[0] == '#') {
+            from_chars(token.data() + 1, token.data() + token.size(), time);
+        }
+        else if (token[0] == 'b' || token[0] == 'B' || token[0] == 'r' || token[0] == 'R') {
+            next(at); // A vector or real value, then its identifier
+        }
+        else if (token[0] == '0' || token[0] == '1') {
+            auto found = codes.find(token.substr(1));
+            if (found != codes.end() && time >= fromTime && !initial) {
+                text.write(static_cast<int>(time), found->second, token[0] - '0');
+            }
+        }
+    }
+    if (!body) {
+        return false;
+    }
+    if (!text.close()) {
+        cerr << "Failed to write the trace file: " << outputFile << endl;
+        return false;
+    }
+    return true;
+}
+
+bool convertTraceToText(const string& path, const string& outputFile, int fromTime) {
+    MappedFile file;
+    if (!file.open(path)) {
+        cerr << "Failed to open trace file: " << path << endl;
+        return false;
+    }
+    string_view data = file.text();
+    if (data.size() >= sizeof(uint64_t)) {
+        uint64_t magic;
+        memcpy(&magic, data.data(), sizeof(magic));
+        if (magic == TraceWriter::BINARY_MAGIC) return convertBinary(data, path, outputFile, fromTime);
+    }
+    if (!convertVcd(data, outputFile, fromTime)) {
+        cerr << "Not a VCD or binary trace: " << path << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,14 @@
+#ifndef TRACECONVERT_H
+#define TRACECONVERT_H
+
+#include <string>
+
+using namespace std;
+
+// Writes a VCD or binary trace back out as a "time, signal, value" text trace, keeping the
+// changes at 'fromTime' or later. A binary trace is read from the first block that can hold
+// that time, without decoding the blocks before it. Returns false if a file could not be read
+// or written, or the trace is damaged.
+bool convertTraceToText(const string& path, const string& outputFile, int fromTime);
+
+#endif // TRACECONVERT_H
@@ -0,0 +1,153 @@
+#include "TraceSort.h"
+#include "Log.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Reads the leading timestamp of a trace line; lines without one sort first
+static long long lineTime(const string& line) {
+    long long time = 0;
+    size_t start = line.find_first_not_of(" \t");
+    if (start != string::npos) {
+        from_chars(line.data() + start, line.data() + line.size(), time);
+    }
+    return time;
+}
+
+// Sorts one run of lines in memory and writes it to its own temporary file
+static bool writeRun(vector<pair<long long, string>>& run, const string& runPath) {
+    stable_sort(run.begin(), run.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    ofstream out(runPath, ios_base::out | ios_base::trunc | ios_base::binary);
+    if (!out.is_open()) {
+        cerr << "Failed to create temporary run file: " << runPath << endl;
+        return false;
+    }
+    for (const auto& entry : run) {
+        out << entry.second << '\n';
+    }
+    run.clear();
+    out.close();
+    if (out.fail()) { // Also catches a full disk, which shows only once the buffer is flushed
+        cerr << "Failed to write temporary run file: " << runPath << endl;
+        return false;
+    }
+    return true;
+}
+
+bool sortTraceFile(const string& path, size_t runLines) {
+    ifstream inputFile(path);
+    if (!inputFile.is_open()) {
+        cerr << "Failed to open output file: " << path << endl;
+        return false;
+    }
+
+    // Splits the trace into sorted runs of at most 'runLines' lines
+    vector<string> runPaths;
+    vector<pair<long long, string>> run;
+    string line;
+    bool ok = true;
+    while (ok && getline(inputFile, line)) {
+        if (line.empty()) continue;
+        run.emplace_back(lineTime(line), line);
+        if (run.size() >= max<size_t>(runLines, 1)) {
+            runPaths.push_back(path + ".run" + to_string(runPaths.size()));
+            ok = writeRun(run, runPaths.back());
+        }
+    }
+    if (ok && inputFile.bad()) {
+        cerr << "Failed to read output file: " << path << endl;
+        ok = false;
+    }
+    if (ok && !run.empty()) {
+        runPaths.push_back(path + ".run" + to_string(runPaths.size()));
+        ok = writeRun(run, runPaths.back());
+    }
+    inputFile.close();
+
+    // Merges the runs; ties go to the earlier run so equal times keep their order
+    struct Head {
+        long long time;
+        size_t run;
+        bool operator>(const Head& other) const {
+            return time != other.time ? time > other.time : run > other.run;
+        }
+    };
+    vector<unique_ptr<ifstream>> runFiles;
+    vector<string> heads(runPaths.size());
+    priority_queue<Head, vector<Head>, greater<Head>> merge;
+    for (size_t r = 0; ok && r < runPaths.size(); ++r) {
+        runFiles.push_back(make_unique<ifstream>(runPaths[r]));
+        if (!runFiles[r]->is_open()) {
+            cerr << "Failed to open temporary run file: " << runPaths[r] << endl;
+            ok = false;
+        }
+        else if (getline(*runFiles[r], heads[r])) {
+            merge.push({ lineTime(heads[r]), r });
+        }
+    }
+
+    string sortedPath = path + ".sorted";
+    ofstream outputFile(sortedPath, ios_base::out | ios_base::trunc | ios_base::binary);
+    if (ok && !outputFile.is_open()) {
+        cerr << "Failed to open output file for writing: " << sortedPath << endl;
+        ok = false;
+    }
+
+    string previous;
+    bool havePrevious = false;
+    while (ok && !merge.empty()) {
+        size_t r = merge.top().run;
+        merge.pop();
+        if (!havePrevious || heads[r] != previous) { // Drops repeated adjacent lines
+            outputFile << heads[r] << '\n';
+            previous = heads[r];
+            havePrevious = true;
+        }
+        if (getline(*runFiles[r], heads[r])) {
+            merge.push({ lineTime(heads[r]), r });
+        }
+    }
+    for (const auto& runFile : runFiles) {
+        if (ok && runFile->bad()) {
+            cerr << "Failed to read a temporary run file of " << path << endl;
+            ok = false;
+        }
+    }
+    outputFile.close();
+    if (ok && outputFile.fail()) {
+        cerr << "Failed to write the sorted trace: " << sortedPath << endl;
+        ok = false;
+    }
+    runFiles.clear();
+
+    for (const auto& runPath : runPaths) {
+        remove(runPath.c_str());
+    }
+    if (!ok) { // The original trace is left as it was
+        remove(sortedPath.c_str());
+        return false;
+    }
+
+    // Replaces the original trace with the sorted one; only where rename cannot replace a file is the original removed first
+    if (rename(sortedPath.c_str(), path.c_str()) != 0) {
+        if (remove(path.c_str()) != 0) {
+            cerr << "Failed to replace " << path << " with the sorted trace" << endl;
+            remove(sortedPath.c_str());
+            return false;
+        }
+        if (rename(sortedPath.c_str(), path.c_str()) != 0) {
+            cerr << "Failed to replace " << path << " with the sorted trace, which is left in " << sortedPath << endl;
+            return false;
+        }
+    }
+    LOG_INFO("Output file sorted and repetitions removed: " << path);
+    return true;
+}
@@ -0,0 +1,14 @@
+#ifndef TRACESORT_H
+#define TRACESORT_H
+
+#include <string>
+
+using namespace std;
+
+// Sorts a "time, signal, value" trace file by time and drops repeated adjacent lines,
+// rewriting it in place. Only 'runLines' lines are held in memory at once: sorted runs
+// are spilled to temporary files next to the trace and merged back. Lines with equal
+// times keep their original order. Returns false if a file could not be read or written.
+bool sortTraceFile(const string& path, size_t runLines = 1 << 20);
+
+#endif // TRACESORT_H
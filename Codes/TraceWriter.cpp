@@ -0,0 +1,401 @@
+#include "TraceWriter.h"
+#include "Log.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+TraceWriter::TraceWriter(size_t bufferSize) : buffer(bufferSize) {}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+void TraceWriter::configure(TraceFormat format, const vector<string>& watchList) {
+    this->format = format;
+    this->watchList = watchList;
+}
+
+bool TraceWriter::open(const string& path, const vector<string>& names, const vector<string>& extraNames) {
+    int numNames = static_cast<int>(names.size());
+    const vector<string>* extra = &extraNames;
+    return openNamed(path, numNames + static_cast<int>(extraNames.size()), [&names, extra, numNames](int signal, string*) {
+        return signal < numNames ? &names[signal] : &(*extra)[signal - numNames];
+    });
+}
+
+bool TraceWriter::open(const string& path, const Netlist& netlist, const vector<string>& extraNames) {
+    const Netlist* source = &netlist;
+    const vector<string>* extra = &extraNames;
+    int numSignals = netlist.numSignals();
+    return openNamed(path, numSignals + static_cast<int>(extraNames.size()), [source, extra, numSignals](int signal, string* built) -> const string* {
+        if (signal >= numSignals) return &(*extra)[signal - numSignals];
+        const string* name = source->topSignalName(signal);
+        if (!name && built) *built = source->signalName(signal);
+        return name;
+    });
+}
+
+bool TraceWriter::openNamed(const string& path, int numSignals, function<const string*(int, string*)> nameOf) {
+    close();
+    this->nameOf = move(nameOf);
+
+    // Numbers the traced signals in id order. The names are needed now to match the watch list or write
+    // a header; otherwise a built one is only made once its signal first changes.
+    bool needNames = !watchList.empty() || format != TraceFormat::Text;
+    traceIndex.assign(numSignals, -1);
+    tracedSignals.clear();
+    tracedNames.clear();
+    builtNames.clear();
+    string built;
+    for (int signal = 0; signal < numSignals; ++signal) {
+        const string* name = this->nameOf(signal, needNames ? &built : nullptr);
+        bool watched = watchList.empty();
+        for (size_t k = 0; k < watchList.size() && !watched; ++k) {
+            watched = matchesPattern(watchList[k], name ? *name : built);
+        }
+        if (watched) {
+            traceIndex[signal] = static_cast<int>(tracedSignals.size());
+            tracedSignals.push_back(signal);
+            if (!name && needNames) {
+                builtNames.push_back(built);
+                name = &builtNames.back();
+            }
+            tracedNames.push_back(name);
+        }
+    }
+
+    file.open(path, ios_base::out | ios_base::trunc | ios_base::binary);
+    flushed = 0;
+    anyRecord = false;
+    failed = false;
+    blockRecords = 0;
+    block.clear();
+    blocks.clear();
+    if (file.is_open()) {
+        writeHeader();
+    }
+    return file.is_open();
+}
+
+// Makes room for 'bytes' more in the buffer, flushing it first if they might not fit
+char* TraceWriter::reserve(size_t bytes) {
+    if (used + bytes > buffer.size()) {
+        flush();
+        if (bytes > buffer.size()) buffer.resize(bytes);
+    }
+    return buffer.data() + used;
+}
+
+void TraceWriter::append(const void* data, size_t bytes) {
+    memcpy(reserve(bytes), data, bytes);
+    used += bytes;
+}
+
+// VCD identifiers are short strings of the printable characters '!' to '~'
+static string vcdCode(int index) {
+    string code;
+    do {
+        code += static_cast<char>('!' + index % 94);
+        index /= 94;
+    } while (index > 0);
+    return code;
+}
+
+static void appendVarint(vector<char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Splits "u1/f0/t" into its scopes and its own name; a name with an empty part is not split
+static void splitScopes(const string& name, vector<string_view>& parts) {
+    parts.clear();
+    string_view rest = name;
+    for (size_t slash; (slash = rest.find('/')) != string_view::npos; rest.remove_prefix(slash + 1)) {
+        parts.push_back(rest.substr(0, slash));
+    }
+    parts.push_back(rest);
+    for (string_view part : parts) {
+        if (part.empty()) {
+            parts.assign(1, name);
+            return;
+        }
+    }
+}
+
+// Declares the traced signals inside the "circuit" scope, each instance's signals in a scope
+// of its own, nested as the instances are; scopes keep the order of their first signal
+void TraceWriter::writeScopes(string& header) {
+    struct Scope {
+        string_view name;
+        vector<size_t> wires; // Traced indices declared directly in the scope
+        vector<int> children;
+    };
+    vector<Scope> scopes(1);
+    scopes[0].name = "circuit";
+    unordered_map<string_view, int> scopeIndex; // By path from the top, "u1/f0"
+    vector<string_view> parts;
+    for (size_t index = 0; index < tracedNames.size(); ++index) {
+        const string& name = *tracedNames[index];
+        splitScopes(name, parts);
+        int scope = 0;
+        size_t pathLength = 0;
+        for (size_t k = 0; k + 1 < parts.size(); ++k) {
+            pathLength += parts[k].size() + (k > 0 ? 1 : 0);
+            auto found = scopeIndex.emplace(string_view(name).substr(0, pathLength), static_cast<int>(scopes.size()));
+            if (found.second) {
+                scopes[scope].children.push_back(static_cast<int>(scopes.size()));
+                scopes.push_back({ parts[k], {}, {} });
+            }
+            scope = found.first->second;
+        }
+        scopes[scope].wires.push_back(index);
+    }
+
+    // Depth first with an explicit stack, since instances may nest deeply; -1 closes a scope
+    vector<int> pending(1, 0);
+    while (!pending.empty()) {
+        int scope = pending.back();
+        pending.pop_back();
+        if (scope < 0) {
+            header += "$upscope $end\n";
+            continue;
+        }
+        header += "$scope module ";
+        header += scopes[scope].name;
+        header += " $end\n";
+        for (size_t index : scopes[scope].wires) {
+            splitScopes(*tracedNames[index], parts);
+            header += "$var wire 1 " + vcdCodes[index] + " ";
+            header += parts.back();
+            header += " $end\n";
+        }
+        pending.push_back(-1);
+        pending.insert(pending.end(), scopes[scope].children.rbegin(), scopes[scope].children.rend());
+    }
+}
+
+void TraceWriter::writeHeader() {
+    if (format == TraceFormat::Vcd) {
+        string header = "$version Logic-Circuits-Simulator $end\n$timescale 1ns $end\n";
+        vcdCodes.clear();
+        for (size_t index = 0; index < tracedSignals.size(); ++index) {
+            vcdCodes.push_back(vcdCode(static_cast<int>(index)));
+        }
+        writeScopes(header);
+        header += "$enddefinitions $end\n";
+        append(header.data(), header.size());
+    }
+    else if (format == TraceFormat::Binary) {
+        uint64_t magic = BINARY_MAGIC;
+        uint32_t version = BINARY_VERSION;
+        append(&magic, sizeof(magic));
+        append(&version, sizeof(version));
+
+        // The names as BinaryWriter::strings lays them out: a counted array of offsets, then the characters
+        vector<uint64_t> offsets(1, 0);
+        for (const string* name : tracedNames) {
+            offsets.push_back(offsets.back() + name->size());
+        }
+        uint64_t count = offsets.size();
+        append(&count, sizeof(count));
+        append(offsets.data(), offsets.size() * sizeof(uint64_t));
+        for (const string* name : tracedNames) {
+            append(name->data(), name->size());
+        }
+    }
+}
+
+void TraceWriter::writeInitialValues(const function<int(int)>& valueOf) {
+    if (format != TraceFormat::Vcd || !file.is_open()) return;
+    string values = "#0\n$dumpvars\n";
+    for (size_t index = 0; index < tracedSignals.size(); ++index) {
+        values += valueOf(tracedSignals[index]) ? '1' : '0';
+        values += vcdCodes[index];
+        values += '\n';
+    }
+    values += "$end\n";
+    append(values.data(), values.size());
+    lastTime = 0; // Changes at time 0 follow without another "#0"
+    anyRecord = true;
+}
+
+bool TraceWriter::write(int time, int signal, int value) {
+    int index = traceIndex[signal];
+    if (index < 0) return false;
+
+    if (format == TraceFormat::Text) {
+        if (!tracedNames[index]) {
+            builtNames.emplace_back();
+            nameOf(signal, &builtNames.back());
+            tracedNames[index] = &builtNames.back();
+        }
+        const string& name = *tracedNames[index];
+        char* out = reserve(name.size() + 32); // Two integers, separators and newline
+        char* start = out;
+        out = to_chars(out, out + 16, time).ptr;
+        *out++ = ',';
+        *out++ = ' ';
+        memcpy(out, name.data(), name.size());
+        out += name.size();
+        *out++ = ',';
+        *out++ = ' ';
+        out = to_chars(out, out + 12, value).ptr;
+        *out++ = '\n';
+        used += out - start;
+    }
+    else if (format == TraceFormat::Vcd) {
+        const string& code = vcdCodes[index];
+        char* out = reserve(code.size() + 16);
+        char* start = out;
+        if (!anyRecord || time != lastTime) { // One "#time" line per timestamp
+            *out++ = '#';
+            out = to_chars(out, out + 12, time).ptr;
+            *out++ = '\n';
+        }
+        *out++ = value ? '1' : '0';
+        memcpy(out, code.data(), code.size());
+        out += code.size();
+        *out++ = '\n';
+        used += out - start;
+    }
+    else {
+        if (blockRecords == 0) {
+            blockFirstTime = time;
+            lastTime = time;
+        }
+        int64_t delta = static_cast<int64_t>(time) - lastTime;
+        appendVarint(block, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+        appendVarint(block, static_cast<uint64_t>(index) * 2 + (value ? 1 : 0));
+        lastTime = time;
+        if (++blockRecords == BINARY_BLOCK_RECORDS) finishBlock();
+    }
+    lastTime = time;
+    anyRecord = true;
+    return true;
+}
+
+// Writes out the binary block being filled and notes where it starts
+void TraceWriter::finishBlock() {
+    if (blockRecords == 0) return;
+    blocks.push_back({ blockFirstTime, lastTime, bytesWritten() });
+    uint32_t bytes = static_cast<uint32_t>(block.size());
+    append(&blockFirstTime, sizeof(blockFirstTime));
+    append(&blockRecords, sizeof(blockRecords));
+    append(&bytes, sizeof(bytes));
+    append(block.data(), block.size());
+    block.clear();
+    blockRecords = 0;
+}
+
+void TraceWriter::writeIndex() {
+    finishBlock();
+    uint64_t indexOffset = bytesWritten();
+    uint64_t count = blocks.size();
+    uint64_t magic = BINARY_INDEX_MAGIC;
+    append(blocks.data(), blocks.size() * sizeof(BlockIndex));
+    append(&count, sizeof(count));
+    append(&indexOffset, sizeof(indexOffset));
+    append(&magic, sizeof(magic));
+}
+
+bool TraceWriter::flush() {
+    if (used > 0 && file.is_open() && !file.write(buffer.data(), used)) {
+        failed = true;
+    }
+    flushed += used;
+    used = 0;
+    return !failed;
+}
+
+bool TraceWriter::appendFileRange(const string& path, uint64_t begin, uint64_t end) {
+    ifstream source(path, ios_base::binary);
+    if (!source.is_open() || !source.seekg(begin)) return false;
+    if (!flush()) return false;
+    for (uint64_t left = end - begin; left > 0;) {
+        size_t chunk = static_cast<size_t>(min<uint64_t>(left, buffer.size()));
+        if (!source.read(buffer.data(), chunk)) return false;
+        used = chunk;
+        if (!flush()) return false;
+        left -= chunk;
+    }
+    return true;
+}
+
+bool TraceWriter::close() {
+    if (file.is_open()) {
+        if (format == TraceFormat::Binary) {
+            writeIndex();
+        }
+        flush();
+        // The stream's own buffer can still fail to reach the disk
+        if (!file.flush()) failed = true;
+        file.close();
+        if (file.fail()) failed = true;
+    }
+    return !failed;
+}
+
+// Backtracks to the last '*' on a mismatch, so the match takes linear time per '*'
+bool matchesPattern(const string& pattern, const string& name) {
+    size_t p = 0, n = 0;
+    size_t star = string::npos, starName = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        }
+        else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            starName = n;
+        }
+        else if (star != string::npos) {
+            p = star + 1;
+            n = ++starName;
+        }
+        else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+const char* traceExtension(TraceFormat format) {
+    switch (format) {
+    case TraceFormat::Vcd: return ".vcd";
+    case TraceFormat::Binary: return ".strace";
+    default: return ".sim";
+    }
+}
+
+string tracePathFor(const string& stimuliFile, const string& outputDir, TraceFormat format) {
+    size_t slash = stimuliFile.find_last_of("/\\");
+    string name = slash == string::npos ? stimuliFile : stimuliFile.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != string::npos && dot > 0) name = name.substr(0, dot);
+    return outputDir + "/" + name + traceExtension(format);
+}
+
+vector<string> tracePathsFor(const vector<string>& stimuliFiles, const string& outputDir, TraceFormat format) {
+    vector<string> paths;
+    unordered_set<string> taken;
+    for (const string& stimuliFile : stimuliFiles) {
+        string path = tracePathFor(stimuliFile, outputDir, format);
+        if (!taken.insert(path).second) {
+            string base = path.substr(0, path.size() - strlen(traceExtension(format)));
+            string renamed;
+            for (int copy = 2; !taken.insert(renamed = base + "-" + to_string(copy) + traceExtension(format)).second; ++copy) {}
+            LOG_WARN("Another stimuli file already writes " << path << "; the trace of " << stimuliFile << " goes to " << renamed);
+            path = renamed;
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
@@ -0,0 +1,128 @@
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include "Netlist.h"
+#include "SimOptions.h"
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Streams the traced signal changes to one file kept open for the whole run. Records are
+// formatted straight into a large user-space buffer that is written out in big blocks, so
+// recording an event costs a few memcpys instead of a file open.
+//
+// A watch list limits the trace to the signals whose names match one of its patterns, where
+// '*' stands for any run of characters and '?' for one character. The formats are:
+// - Text: "time, signal, value" lines, the format of the expected_output*.sim files.
+// - Vcd: a Value Change Dump with one 1-bit wire per traced signal, in nanoseconds. A signal
+//   inside a module instance, "u1/f0/t", is declared as wire t in scope f0 of scope u1.
+// - Binary: a header with the traced signal names, then blocks of up to BINARY_BLOCK_RECORDS records, each
+//   a varint of the time change since the previous record (zigzag-encoded, so it may be
+//   negative) and a varint of 2 * signal index + value. Every block starts from its own first
+//   time so it can be decoded alone, and an index of the blocks' time ranges and offsets at the
+//   end of the file lets a reader start at any time without decoding what comes before it.
+class TraceWriter {
+public:
+    static const uint32_t BINARY_BLOCK_RECORDS = 4096;
+    static const uint64_t BINARY_MAGIC = 0x454341525453434Cull; // "LCSTRACE" in memory order, starts the file
+    static const uint64_t BINARY_INDEX_MAGIC = 0x584449525453434Cull; // "LCSTRIDX", ends the file
+    static const uint32_t BINARY_VERSION = 1;
+
+    explicit TraceWriter(size_t bufferSize = 1 << 20);
+    ~TraceWriter();
+
+    // Chooses the format and the signals to record; applies from the next open
+    void configure(TraceFormat format, const vector<string>& watchList);
+
+    // Truncates any previous trace at 'path'. Signal ids below names.size() are named by
+    // 'names', the following ones by 'extraNames'; both must stay alive until the trace is closed.
+    bool open(const string& path, const vector<string>& names, const vector<string>& extraNames = {});
+
+    // The same with the signals of 'netlist', which must also stay alive; the names of signals
+    // inside module instances are built once, for the traced ones only
+    bool open(const string& path, const Netlist& netlist, const vector<string>& extraNames = {});
+    bool isOpen() const { return file.is_open(); }
+
+    // True if changes of 'signal' are recorded
+    bool watches(int signal) const { return traceIndex[signal] >= 0; }
+
+    // VCD: records the value of each traced signal before the first change, as its $dumpvars; the
+    // other formats hold changes only. Call once after open, before any write.
+    void writeInitialValues(const function<int(int)>& valueOf);
+
+    // Records a change of 'signal'; returns false, writing nothing, if the signal is not watched
+    bool write(int time, int signal, int value);
+
+    // Both return false if any part of the trace could not be written, a full disk for example
+    bool flush();
+    bool close();
+
+    // True for a text trace of every signal, the only kind that can be spliced byte by byte
+    bool recordsEverything() const { return format == TraceFormat::Text && watchList.empty(); }
+
+    // Bytes of trace written since open, including those still in the buffer
+    uint64_t bytesWritten() const { return flushed + used; }
+
+    // Appends bytes [begin, end) of another trace file unchanged
+    bool appendFileRange(const string& path, uint64_t begin, uint64_t end);
+
+private:
+    // Index entry of a binary block
+    struct BlockIndex {
+        int firstTime;
+        int lastTime;
+        uint64_t offset;
+    };
+
+    ofstream file;
+    vector<char> buffer;
+    size_t used = 0;
+    uint64_t flushed = 0;
+
+    TraceFormat format = TraceFormat::Text;
+    vector<string> watchList;
+    vector<int> traceIndex; // Per signal id, its index among the traced signals, or -1
+    vector<int> tracedSignals; // Signal id of each index
+    function<const string*(int, string*)> nameOf; // A signal's name if kept elsewhere, else null after building it if asked
+    vector<const string*> tracedNames; // Name of each index; null until built for a text trace
+    deque<string> builtNames; // The traced names no netlist keeps
+    vector<string> vcdCodes; // VCD identifier of each index
+    int lastTime = 0;
+    bool anyRecord = false;
+    bool failed = false; // A write to the file failed since it was opened
+
+    vector<char> block; // Binary: encoded records of the block being filled
+    uint32_t blockRecords = 0;
+    int blockFirstTime = 0;
+    vector<BlockIndex> blocks;
+
+    bool openNamed(const string& path, int numSignals, function<const string*(int, string*)> nameOf);
+    char* reserve(size_t bytes);
+    void append(const void* data, size_t bytes);
+    void writeHeader();
+    void writeScopes(string& header);
+    void finishBlock();
+    void writeIndex();
+};
+
+// Matches a signal name against a watch list pattern with '*' and '?' wildcards
+bool matchesPattern(const string& pattern, const string& name);
+
+// File extension for traces of 'format': .sim, .vcd or .strace
+const char* traceExtension(TraceFormat format);
+
+// Trace file for a stimuli file when several are simulated: its name with the extension of
+// 'format', in 'outputDir'
+string tracePathFor(const string& stimuliFile, const string& outputDir, TraceFormat format = TraceFormat::Text);
+
+// The trace files of several stimuli files, as tracePathFor names them, except that a file whose
+// trace name is already taken, by a file of the same name in another folder, gets "-2", "-3", ...
+// added to it, with a warning
+vector<string> tracePathsFor(const vector<string>& stimuliFiles, const string& outputDir, TraceFormat format = TraceFormat::Text);
+
+#endif // TRACEWRITER_H
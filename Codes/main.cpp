@@ -1,17 +1,256 @@
 #include "GateSimulator.h"
+#include "Log.h"
 #include "Event.h"
 #include "Gate.h"
+#include "SimOptions.h"
+#include "TraceSort.h"
+#include "TraceConvert.h"
+#include "TraceWriter.h"
+#include "BitParallelSimulator.h"
+#include "LevelizedSimulator.h"
+#include "ParallelSimulator.h"
+#include "BatchSimulator.h"
+#include "FaultSimulator.h"
+#include <climits>
+#include <thread>
 
 using namespace std;
 
+// Prints the command line syntax and the available options
+static void printUsage(const char* program) {
+	cerr << "Usage: " << program << " [options] <library file> <circuit file> <stimuli file>" << endl;
+	cerr << "       " << program << " --mode bitparallel [options] <library file> <circuit file> <stimuli file>..." << endl;
+	cerr << "       " << program << " --mode batch [options] <library file> <circuit file> <stimuli file>..." << endl;
+	cerr << "       " << program << " --mode fault [options] <library file> <circuit file> <stimuli file>" << endl;
+	cerr << "       " << program << " --mode server [--socket <path>] [options] <library file> <circuit file>" << endl;
+	cerr << "       " << program << " --mode submit [--socket <path>] [--output-dir <dir>] <stimuli file>..." << endl;
+	cerr << "       " << program << " --mode stop-server [--socket <path>]" << endl;
+	cerr << "       " << program << " --sort-trace <trace file>" << endl;
+	cerr << "       " << program << " --convert-trace <VCD or binary trace> [--from <time>] [-o <text trace>]" << endl;
+	cerr << "Options:" << endl;
+	cerr << "  -o, --output <file>   Write the simulation trace to <file> (default: output.sim, or output.vcd/.strace)" << endl;
+	cerr << "  --trace-format <fmt>  text (default): \"time, signal, value\" lines; vcd: Value Change Dump;" << endl;
+	cerr << "                        binary: delta-encoded blocks with a time index, see --convert-trace" << endl;
+	cerr << "  --watch <patterns>    Trace only the signals matching one of the comma-separated names or" << endl;
+	cerr << "                        patterns (* and ? wildcards); may be repeated" << endl;
+	cerr << "  --mode <mode>         event (default): one stimuli file, event-driven" << endl;
+	cerr << "                        bitparallel: many stimuli files, 64 per pass in the bits of each signal word" << endl;
+	cerr << "                        levelized: zero-delay sweep in topological order, writes the primary outputs" << endl;
+	cerr << "                        at each stimulus time point" << endl;
+	cerr << "                        parallel: event-driven on several threads with --transport-delay, same trace as event" << endl;
+	cerr << "                        fault: stuck-at fault coverage of the stimuli; -o lists the undetected faults" << endl;
+	cerr << "                        batch: many stimuli files, event-driven, several files at once on a thread pool" << endl;
+	cerr << "                        server: load the circuit once and run the stimuli files sent with submit" << endl;
+	cerr << "                        submit: send stimuli files to a running server; stop-server: stop it" << endl;
+	cerr << "  --transport-delay     Propagate every gate output change, even pulses shorter than the gate delay" << endl;
+	cerr << "                        (default: inertial delay, such pulses are cancelled)" << endl;
+	cerr << "  --optimize            Event, parallel and levelized modes: fold constant inputs, collapse buffers and" << endl;
+	cerr << "                        inverters where the timing allows it, and drop gates the trace cannot show" << endl;
+	cerr << "  --profile <file>      Event mode: count the evaluations and scheduled events of each gate and the events" << endl;
+	cerr << "                        of each signal, print the busiest ones and write every count to <file> (.json, else CSV)" << endl;
+	cerr << "  --profile-top <n>     Gates and signals listed in the --profile report (default: 10)" << endl;
+	cerr << "  --threads <n>         Threads for the parallel, fault, batch and server modes (default: all hardware threads)" << endl;
+	cerr << "  --cache <file>        Load the parsed circuit from <file>, or write it there if it is missing or stale" << endl;
+	cerr << "  --history <file>      Event mode: keep checkpoints in <file> and re-simulate only from the first changed" << endl;
+	cerr << "                        stimulus when the same circuit is run again into the same trace" << endl;
+	cerr << "  --checkpoint-every <n> Events between checkpoints in the --history file (default: 100000)" << endl;
+	cerr << "  --parse-threads <n>   Tokenize the circuit file on <n> threads (default: 1)" << endl;
+	cerr << "  --scaling-report      Parallel mode: time the run on 1, 2, 4, ... up to --threads threads" << endl;
+	cerr << "  -v, --verbose         Print more detail; repeat for debug output" << endl;
+	cerr << "  -q, --quiet           Print only warnings and errors" << endl;
+	cerr << "  --output-dir <dir>    Folder for the per-stimuli traces of the bitparallel, batch and submit modes (default: .)" << endl;
+	cerr << "  --socket <path>       Unix socket of the simulation server (default: sim.sock)" << endl;
+	cerr << "  --sort-trace <file>   Sort an unsorted trace by time in bounded memory and drop repeated lines" << endl;
+	cerr << "  --convert-trace <file> Write a VCD or binary trace as a text trace to -o, from --from <time> on" << endl;
+}
+
 int main(int argc, char* argv[]) {
-	if (argc != 4) {
-		cerr << "Usage: " << argv[0] << " <library file> <circuit file> <stimuli file>" << endl;
-		return 1;
+	SimOptions options;
+	vector<string> files;
+	bool outputGiven = false;
+	string convertFile;
+	int fromTime = INT_MIN;
+
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+			options.outputFile = argv[++i];
+			outputGiven = true;
+		}
+		else if (arg == "--mode" && i + 1 < argc) {
+			options.mode = argv[++i];
+		}
+		else if (arg == "-v" || arg == "--verbose") {
+			logVerbosity = min(logVerbosity + 1, LOG_LEVEL_TRACE);
+		}
+		else if (arg == "-q" || arg == "--quiet") {
+			logVerbosity = LOG_LEVEL_WARN;
+		}
+		else if (arg == "--threads" && i + 1 < argc) {
+			options.threads = atoi(argv[++i]);
+		}
+		else if (arg == "--cache" && i + 1 < argc) {
+			options.cacheFile = argv[++i];
+		}
+		else if (arg == "--history" && i + 1 < argc) {
+			options.historyFile = argv[++i];
+		}
+		else if (arg == "--checkpoint-every" && i + 1 < argc) {
+			options.checkpointEvents = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--parse-threads" && i + 1 < argc) {
+			options.parseThreads = atoi(argv[++i]);
+		}
+		else if (arg == "--transport-delay") {
+			options.transportDelay = true;
+		}
+		else if (arg == "--optimize") {
+			options.optimize = true;
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			options.profileFile = argv[++i];
+		}
+		else if (arg == "--profile-top" && i + 1 < argc) {
+			options.profileTop = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--scaling-report") {
+			options.scalingReport = true;
+		}
+		else if (arg == "--output-dir" && i + 1 < argc) {
+			options.outputDir = argv[++i];
+		}
+		else if (arg == "--socket" && i + 1 < argc) {
+			options.socketPath = argv[++i];
+		}
+		else if (arg == "--trace-format" && i + 1 < argc) {
+			string format = argv[++i];
+			if (format == "text") options.traceFormat = TraceFormat::Text;
+			else if (format == "vcd") options.traceFormat = TraceFormat::Vcd;
+			else if (format == "binary") options.traceFormat = TraceFormat::Binary;
+			else {
+				cerr << "Unknown trace format: " << format << endl;
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (arg == "--watch" && i + 1 < argc) {
+			string list = argv[++i];
+			for (size_t start = 0; start <= list.size();) {
+				size_t comma = min(list.find(',', start), list.size());
+				if (comma > start) options.watchList.push_back(list.substr(start, comma - start));
+				start = comma + 1;
+			}
+		}
+		else if (arg == "--convert-trace" && i + 1 < argc) {
+			convertFile = argv[++i];
+		}
+		else if (arg == "--from" && i + 1 < argc) {
+			fromTime = atoi(argv[++i]);
+		}
+		else if (arg == "--sort-trace" && i + 1 < argc) {
+			return sortTraceFile(argv[++i]) ? 0 : 1; // Cleans up a trace written by an older version
+		}
+		else if (arg.size() > 1 && arg[0] == '-') {
+			cerr << "Unknown option: " << arg << endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+
+	if (!convertFile.empty()) {
+		return convertTraceToText(convertFile, options.outputFile, fromTime) ? 0 : 1;
+	}
+	if (!outputGiven && options.mode != "fault") {
+		options.outputFile = string("output") + traceExtension(options.traceFormat);
+	}
+
+	if (options.optimize && options.mode != "event" && options.mode != "parallel" && options.mode != "levelized") {
+		LOG_WARN("--optimize only applies to the event, parallel and levelized modes; ignoring it");
+		options.optimize = false;
+	}
+
+	if (!options.profileFile.empty() && options.mode != "event") {
+		LOG_WARN("--profile only applies to the event mode; ignoring it");
+		options.profileFile.clear();
+	}
+
+	int threads = options.threads > 0 ? options.threads : max(1, static_cast<int>(thread::hardware_concurrency()));
+
+	if (options.mode == "parallel" && !options.transportDelay && threads > 1) {
+		// A cancelled change could already have been handed to another thread, so there is no safe lookahead
+		LOG_WARN("--mode parallel runs on one thread under inertial delay; add --transport-delay to use " << threads << " threads");
+		threads = 1;
+	}
+
+	if (options.mode == "submit" && !files.empty()) {
+		return BatchSimulator::submit(options.socketPath, files, options.outputDir, options.traceFormat) ? 0 : 1;
+	}
+
+	if (options.mode == "stop-server" && files.empty()) {
+		return BatchSimulator::requestShutdown(options.socketPath) ? 0 : 1;
+	}
+
+	if ((options.mode == "batch" && files.size() >= 3) || (options.mode == "server" && files.size() == 2)) {
+		GateSimulator circuit(files[0], files[1], options); // Loads and settles the circuit once for every stimuli file
+		BatchSimulator simulator(circuit.getNetlist(), circuit.getFunctions(), circuit.getMaxDelay(), circuit.getSettledStates(), options);
+		if (options.mode == "server") {
+			return simulator.serve(options.socketPath, threads) ? 0 : 1;
+		}
+		vector<string> stimuliFiles(files.begin() + 2, files.end());
+		return simulator.run(stimuliFiles, threads) ? 0 : 1;
+	}
+
+	if (options.mode == "bitparallel" && files.size() >= 3) {
+		GateSimulator circuit(files[0], files[1], options); // Loads the library and circuit once for every stimuli file
+		circuit.expandInstances();
+		BitParallelSimulator simulator(circuit.getNetlist(), circuit.getFunctions(), circuit.getMaxDelay(), options);
+		vector<string> stimuliFiles(files.begin() + 2, files.end());
+		return simulator.run(stimuliFiles) ? 0 : 1;
 	}
 
-	GateSimulator simulator(argv[1], argv[2], argv[3]); // // Creates a GateSimulator object with the provided file paths
-	simulator.startSimulation(); // Starts the simulation process
+	if (options.mode == "levelized" && files.size() == 3) {
+		GateSimulator circuit(files[0], files[1], options);
+		circuit.expandInstances();
+		if (options.optimize) circuit.optimize(files[2], true);
+		LevelizedSimulator simulator(circuit.getNetlist(), circuit.getFunctions(), options);
+		if (!simulator.levelize()) {
+			return 1; // Combinational loops have no zero-delay order
+		}
+		return simulator.run(files[2]) ? 0 : 1;
+	}
+
+	if (options.mode == "fault" && files.size() == 3) {
+		GateSimulator circuit(files[0], files[1], options);
+		circuit.expandInstances();
+		FaultSimulator simulator(circuit.getNetlist(), circuit.getFunctions(), options);
+		if (!simulator.levelize() || !simulator.loadStimuli(files[2])) {
+			return 1;
+		}
+		return simulator.run(threads) ? 0 : 1;
+	}
+
+	if (options.mode == "parallel" && files.size() == 3) {
+		GateSimulator circuit(files[0], files[1], options);
+		circuit.expandInstances();
+		if (options.optimize) circuit.optimize(files[2], false);
+		ParallelSimulator simulator(circuit.getNetlist(), circuit.getFunctions(), circuit.getMaxDelay(), circuit.getSettledStates(), options);
+		if (!simulator.loadStimuli(files[2])) {
+			return 1;
+		}
+		simulator.countSavedEvents(circuit.getOptimizeStats().mirroredSignals);
+		bool ok = options.scalingReport ? simulator.reportScaling(threads) : simulator.run(threads);
+		if (options.optimize) circuit.reportOptimization(simulator.getStats());
+		return ok ? 0 : 1;
+	}
+
+	if (options.mode != "event" || files.size() != 3) {
+		printUsage(argv[0]);
+		return 1;
+	}
 
-	return 0;
+	GateSimulator simulator(files[0], files[1], files[2], options); // // Creates a GateSimulator object with the provided file paths
+	return simulator.startSimulation() ? 0 : 1; // Starts the simulation process
 }